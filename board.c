@@ -13,19 +13,20 @@
 #include "types.h"
 #include "variant.h"
 
-VariantDesc *variant;
-int bFiles, bRanks, zone, currentVariant, repDraws, stalemate;
+THREAD VariantDesc *variant;
+THREAD int bFiles, bRanks, zone, currentVariant, repDraws, stalemate;
 
-int framePtr;
-int cnt50;
+THREAD int framePtr;
+THREAD int cnt50;
 
-int board[BSIZE] = { [0 ... BSIZE-1] = EDGE };
+THREAD int board[BSIZE] = { [0 ... BSIZE-1] = EDGE };
 
-int attacksByLevel[LEVELS][COLORS][BSIZE];
-int multis[COLORS], multiMovers[NPIECES];
+THREAD int attacksByLevel[LEVELS][COLORS][BSIZE];
+THREAD int multis[COLORS], multiMovers[NPIECES];
 
-Flag fireBoard[BSIZE]; // flags to indicate squares controlled by Fire Demons
-Flag fireFlags[10]; // flags for Fire-Demon presence (last two are dummies, which stay 0, for compactify)
+THREAD Flag fireBoard[BSIZE]; // flags to indicate squares controlled by Fire Demons
+THREAD Flag fireFlags[10]; // flags for Fire-Demon presence (last two are dummies, which stay 0, for compactify)
+THREAD int jumpStop[RANKS][RAYS][BSIZE]; // nearest square range jumpers of given rank cannot jump over
 
 Flag
 IsEmpty (int sqr)
@@ -33,19 +34,116 @@ IsEmpty (int sqr)
   return board[sqr] == EMPTY;
 }
 
+#define NIDS 78 /* A-Z, also suffixed with ' or ! */
+
+// piece-ID flags
+#define ID_CP    1 /* ID is Crown Prince                   */
+#define ID_DE    2 /* ID is Drunk Elephant (prince when +) */
+#define ID_TO_CP 4 /* promotes to Crown Prince             */
+
+typedef struct {
+  PieceDesc *desc, *promo; // what the ID stands for in this variant, and what that promotes to
+  char flags;
+} IDInfo;
+
+THREAD IDInfo idTable[NIDS];
+THREAD char *idSource;    // ID string and variant the table was made for
+THREAD int idVariant;
+THREAD PieceDesc *kingDesc, *princeDesc;
+
+typedef struct {
+  PieceDesc *desc;
+  int pos, promo;         // square (or ABSENT), and entry of promoted version (or -1)
+} SetUpEntry;
+
+THREAD SetUpEntry entries[COLORS][NPIECES/2];
+THREAD int nrEntries[COLORS], order[COLORS][NPIECES/2]; // entries sorted like the piece list
+
+void
+MakeIDTable (char *IDs, int var)
+{ // resolve the piece names of all IDs once, so that SetUp does not need the by-name LookUp
+  int i, n = strlen(IDs)/2;
+  char name[3];
+  for(i=0; i<NIDS; i++) {
+    IDInfo *id = idTable + i;
+    PieceDesc *d = NULL;
+    id->flags = 0;
+    if(i < n) {
+      name[0] = IDs[2*i]; name[1] = '\0';
+      d = LookUp(name, var);
+      name[1] = IDs[2*i+1]; name[2] = '\0'; if(name[1] == ' ') name[1] = '\0';
+      if(!strcmp(name, "CP")) id->flags |= ID_CP;
+      if(!strcmp(name, "DE")) id->flags |= ID_DE;
+      if(LookUp(name, var)) d = LookUp(name, var);
+    }
+    id->desc = d; id->promo = NULL;
+    if(d && d->promoted[0]) {
+      id->promo = LookUp(d->promoted, var);
+      if(!strcmp(d->promoted, "CP")) id->flags |= ID_TO_CP;
+    }
+  }
+  kingDesc = LookUp("K", V_CHU); princeDesc = LookUp("CP", V_CHU);
+  idSource = IDs; idVariant = var;
+}
+
+int
+AddEntry (Color c, PieceDesc *desc, int pos)
+{ // record piece for SetUp, and find its place in the value-sorted order (shifting only ints)
+  int i, k = nrEntries[c], *o = order[c];
+  SetUpEntry *e = entries[c];
+  if(k >= NPIECES/2 - 1) printf("tellusererror Too many pieces in setup\n"), FATAL();
+  PieceKey(c, desc); // create hash key in same order as before
+  e[k].desc = desc; e[k].pos = pos; e[k].promo = -1;
+  for(i=0; i<k; i++) if(e[o[i]].desc->value < desc->value || e[o[i]].desc->value == desc->value && e[o[i]].promo < 0) break;
+  memmove(o + i + 1, o + i, (k - i)*sizeof(int));
+  o[i] = k;
+  return nrEntries[c]++;
+}
+
+void
+BuildPieceList (Color c)
+{ // fill the value-sorted piece list in one go, instead of inserting the pieces one by one
+  int i, k, nr = nrEntries[c], *o = order[c], slot[NPIECES/2];
+  SetUpEntry *e = entries[c];
+  pieces[c] = c + 2*nr;
+  for(k=nr-1; k>=0; k--) { // backwards, so royal[c] ends up as first of equal-valued royals
+    i = c + 2 + 2*k; slot[o[k]] = i;
+    FillPiece(c, i, e[o[k]].desc);
+    p[i].pos = e[o[k]].pos;
+    p[i].promo = -1;
+  }
+  for(i=c+2; i<=pieces[c]; i+=2) { // pieces of one type share the number of the first slot with it
+    for(k=c+2; pieceDesc[k] != pieceDesc[i]; k+=2) {}
+    p[i].kind = k;
+  }
+  for(k=0; k<nr; k++) if(e[k].promo >= 0) { // link promotable pieces to their promoted version
+    PieceDesc *p1 = e[k].desc, *p2 = e[e[k].promo].desc;
+    int n = slot[k], m = slot[e[k].promo];
+    p[n].promo = m;
+    p[n].promoFlag = IsUpwardCompatible(p2->range, p1->range) * DONT_DEFER + CAN_PROMOTE;
+    if(ForwardOnly(p1->range)) p[n].promoFlag |= LAST_RANK; // Pieces that only move forward can't defer on last rank
+    if(!strcmp(p1->name, "N")) p[n].promoFlag |= CANT_DEFER; // Knights can't defer on last 2 ranks
+    p[n].promoFlag &= n&1 ? P_WHITE : P_BLACK;
+#if KYLIN
+    if(!strcmp(p2->name, "LN")) kylin[c] = n; // remember piece that promotes to Lion
+#endif
+  }
+}
+
 void
 SetUp (char *fen, char *IDs, int var)
 {
   int i, j, n, m, color;
-  char name[3], prince = 0;
-  pieces[WHITE] = WHITE; pieces[BLACK] = BLACK;
+  char prince = 0;
+  if(IDs != idSource || var != idVariant) MakeIDTable(IDs, var);
+  nrEntries[WHITE] = nrEntries[BLACK] = 0;
   royal[WHITE] = royal[BLACK] = 0;
   for(i=bRanks-1; ; i--) {
 //printf("next rank: %s\n", fen);
     for(j = bFiles*i; ; j++) {
       int pflag=0;
       if(*fen == '+') pflag++, fen++;
-      int ch = name[0] = *fen++;
+      int ch = *fen++;
       if(!ch) goto eos;
       if(ch == '.') continue;
       if(ch > '0' && ch <= '9') {
@@ -53,53 +151,36 @@ SetUp (char *fen, char *IDs, int var)
         j += ch - 1; continue;
       }
       if(ch == '/') break;
-      name[1] = name[2] = '\0';
       if(ch >= 'a') {
 	color = BLACK;
 	ch += 'A' - 'a';
       } else color = WHITE;
       if(*fen == '\'') ch += 26, fen++; else
       if(*fen == '!')  ch += 52, fen++;
-      name[0] = IDs[2*(ch - 'A')];
-      PieceDesc *p0 = LookUp(name, var);
-      name[1] = IDs[2*(ch - 'A') + 1]; if(name[1] == ' ') name[1] = '\0';
-      if(!strcmp(name, "CP") || pflag && !strcmp(name, "DE")) prince |= color+1; // remember if we added Crown Prince
-      PieceDesc *p1 = LookUp(name, var);
-      if(!p1) p1=p0;
-      if(!p1) printf("tellusererror Unknown piece '%s' in setup (%d)\n", name, ch), exit(-1);
-      if(pflag && p1->promoted) p1 = LookUp(p1->promoted, var); // use promoted piece instead
-      n = AddPiece(color, p1);
-      p[n].pos = POS(j / bFiles, j % bFiles);
-      if(p1->promoted[0] && !pflag) {
-        if(!strcmp(p1->promoted, "CP")) prince |= color+1; // remember if we added Crown Prince
-        PieceDesc *p2 = LookUp(p1->promoted, var);
-        m = AddPiece(color, p2);
-	if(m <= n) n += 2;
-	if(p2->ranking > 5) { // contageous
-	  AddPiece(color, p2);
-	  if(m <= n) n += 2;
-	}
-	p[n].promo = m;
-	p[n].promoFlag = IsUpwardCompatible(p2->range, p1->range) * DONT_DEFER + CAN_PROMOTE;
-	if(ForwardOnly(p1->range)) p[n].promoFlag |= LAST_RANK; // Pieces that only move forward can't defer on last rank
-	if(!strcmp(p1->name, "N")) p[n].promoFlag |= CANT_DEFER; // Knights can't defer on last 2 ranks
-	p[n].promoFlag &= n&1 ? P_WHITE : P_BLACK;
-	p[m].promo = -1;
-	p[m].pos = ABSENT;
-#if KYLIN
-	if(!strcmp(p2->name, "LN")) kylin[color] = n; // remember piece that promotes to Lion
-#endif
-      } else p[n].promo = -1; // unpromotable piece
-//printf("piece = %c%-2s %d(%d) %d/%d\n", color ? 'w' : 'b', name, n, m, last[color], last[!color]);
+      if(ch < 'A' || ch >= 'A' + NIDS || !idTable[ch - 'A'].desc) printf("tellusererror Unknown piece in setup (%d)\n", ch), FATAL();
+      IDInfo *id = idTable + ch - 'A';
+      PieceDesc *p1 = id->desc;
+      if(id->flags & ID_CP || pflag && id->flags & ID_DE) prince |= color+1; // remember if we added Crown Prince
+      if(pflag && id->promo) p1 = id->promo; // use promoted piece instead
+      n = AddEntry(color, p1, POS(j / bFiles, j % bFiles));
+      if(id->promo && !pflag) {
+        if(id->flags & ID_TO_CP) prince |= color+1; // remember if we added Crown Prince
+        m = AddEntry(color, id->promo, ABSENT);
+	if(id->promo->ranking > 5) AddEntry(color, id->promo, ABSENT); // contageous
+	entries[color][n].promo = m;
+      }
     }
   }
  eos:
   // add dummy Kings if not yet added (needed to set royal[] to valid value!)
-  if(!royal[WHITE]) p[AddPiece(WHITE, LookUp("K", V_CHU))].pos = ABSENT;
-  if(!royal[BLACK]) p[AddPiece(BLACK, LookUp("K", V_CHU))].pos = ABSENT;
+  for(n=0; n<nrEntries[WHITE] && entries[WHITE][n].desc->value != ROYALVAL; n++);
+  if(n == nrEntries[WHITE]) AddEntry(WHITE, kingDesc, ABSENT);
+  for(n=0; n<nrEntries[BLACK] && entries[BLACK][n].desc->value != ROYALVAL; n++);
+  if(n == nrEntries[BLACK]) AddEntry(BLACK, kingDesc, ABSENT);
   // add dummy Crown Princes if not yet added
-  if(!(prince & WHITE+1)) p[AddPiece(WHITE, LookUp("CP", V_CHU))].pos = ABSENT;
-  if(!(prince & BLACK+1)) p[AddPiece(BLACK, LookUp("CP", V_CHU))].pos = ABSENT;
+  if(!(prince & WHITE+1)) AddEntry(WHITE, princeDesc, ABSENT);
+  if(!(prince & BLACK+1)) AddEntry(BLACK, princeDesc, ABSENT);
+  BuildPieceList(WHITE); BuildPieceList(BLACK);
   for(i=0; i<RAYS; i++)  fireFlags[i] = 0;
   for(i=2, n=1; i<10; i++) if(DEMON(i)) {
     int x = p[i].pos; // mark all burn zones
@@ -108,6 +189,7 @@ SetUp (char *fen, char *IDs, int var)
     n <<= 1;
   }
   for(i=2; i<6; i++) if(p[i].ranking == 5) p[i].promo = -1, p[i].promoFlag = 0; // take promotability away from Werewolves
+  for(i=0; i<BSIZE; i++) board[i] = EDGE; // a previous variant may have used a larger board
   for(i=0; i<bRanks; i++) for(j=0; j<bFiles; j++) board[POS(i, j)] = EMPTY;
   for(i=WHITE+2; i<=pieces[WHITE]; i+=2) if(p[i].pos != ABSENT) {
     int g = p[i].promoGain;
@@ -124,7 +206,7 @@ SetUp (char *fen, char *IDs, int var)
     board[p[i].pos] = i;
     rootEval += p[i].value + PSQ(p[i].pst, p[i].pos, WHITE);
     promoDelta += p[i].promoGain;
-    filling += p[i].bulk;
+    filling += p[i].bulk; men++;
   } else p[i].promoGain = 0;
   for(i=BLACK+2; i<=pieces[BLACK]; i+=2) if(p[i].pos != ABSENT) {
     int g = p[i].promoGain;
@@ -141,10 +223,11 @@ SetUp (char *fen, char *IDs, int var)
     board[p[i].pos] = i;
     rootEval -= p[i].value + PSQ(p[i].pst, p[i].pos, BLACK);
     promoDelta -= p[i].promoGain;
-    filling += p[i].bulk;
+    filling += p[i].bulk; men++;
   } else p[i].promoGain = 0;
   StackMultis(WHITE);
   StackMultis(BLACK);
+  if(tenFlag) MapBarriers();
 }
 
 void
@@ -161,6 +244,56 @@ StackMultis (Color c)
   }
 }
 
+static void
+SweepBarriers (int sqr, int dir)
+{ // recalculate jumpStop for the ray in direction dir through sqr, working back from the edge it runs into
+  int r, y, v = kStep[dir], end = sqr;
+  while(board[end] != EDGE) end += v;
+  for(r=1; r<RANKS; r++) {
+    int stop = end;
+    for(y=end-v; board[y] != EDGE; y-=v) {
+      jumpStop[r][dir][y] = stop;
+      if(p[board[y]].qval >= r) stop = y; // jumpers of this rank cannot pass this one
+    }
+  }
+}
+
+static void
+LineBarriers (int sqr)
+{ // a ranked piece appeared or disappeared on sqr: only the lines through it are affected
+  int j;
+  if(board[sqr] == EDGE) return;
+  for(j=0; j<RAYS; j++) SweepBarriers(sqr, j);
+}
+
+void
+MapBarriers ()
+{ // sweep all lines from scratch (after setup)
+  int i, j;
+  for(i=0; i<BSIZE; i++) if(board[i] != EDGE)
+    for(j=0; j<RAYS; j++) if(board[i-kStep[j]] == EDGE) SweepBarriers(i, j); // i starts a line in direction j
+}
+
+static void
+ReBarrier (UndoInfo *u)
+{ // update jump barriers for all squares where a move (or its take-back) changed the presence of a ranked piece
+  int i;
+  if(p[u->piece].qval | p[u->new].qval | p[u->victim].qval) LineBarriers(u->from), LineBarriers(u->to);
+  if(u->epVictim[0] == EDGE) { // burns
+    for(i=0; i<RAYS; i++) if(u->epVictim[i+1] != EDGE && p[u->epVictim[i+1]].qval) LineBarriers(u->to + kStep[i]);
+  } else if(u->epVictim[0]) {  // Lion victims
+    if(p[u->epVictim[0]].qval) LineBarriers(u->epSquare);
+    if(p[u->epVictim[1]].qval) LineBarriers(u->ep2Square);
+  }
+}
+
+int
+WalkBarrier (int c, int dir, int sqr)
+{ // what jumpStop holds, found by stepping (reference for the table, in builds with NO_JUMP_TABLE)
+  while(p[board[sqr += kStep[dir]]].qval < c) {} // kludge alert: EDGE has qval = 5, blocking everything
+  return sqr;
+}
+
 int
 PSTest ()
 {
@@ -259,14 +392,13 @@ MapAttacksByColor (Color color, int pieces, int level)
         if(pi->range[j] > X) { // jump capturer
           int c = pi->qval;
           if(p[board[y]].qval < c) {
-            y += v; // go behind directly captured piece, if jumpable
-            while(p[board[y]].qval < c) { // kludge alert: EDGE has qval = 5, blocking everything
+            int stop = JUMPSTOP(c, j, y); // go behind directly captured piece, up to what we cannot jump
+            while((y += v) != stop) {
               if(board[y] != EMPTY) {
 //              int n = ATTACK(y, color) & attackMask[j];
 //              ATTACK(y, color) += (n < 3*one[j] ? 3*one[j] : ray[j]); // first jumper gets 2 extra (to ease incremental update)
                 ATTACK(y, color) += ray[j]; // for now use true count
               }
-              y += v;
             }
           }
         }
@@ -287,6 +419,45 @@ MapAttacks (int level)
   return whiteMob - blackMob;
 }
 
+int
+SquareAttacked (int sqr, Color c)
+{ // scan outward from sqr for a piece of color c that attacks it, counting the same moves as MapAttacksByColor
+  int i, j, k, r, y;
+  for(j=0; j<RAYS; j++) {
+    int v = kStep[j], last = 0, bar = 0; // last = occupied square nearest to the scanned one, on the path to sqr; bar = highest qval on that path
+    for(y=sqr-v, k=1; (i = board[y]) != EDGE; y-=v, k++) {
+      if(i != EMPTY && (i & TYPE) == c) {
+        r = p[i].range[j];
+        if(r > 0) {
+          if(!last) { if(k <= r) return 1; }
+          else if(r > X && bar < p[i].qval) return 1; // jump capturer that can jump over everything on its path
+        } else if(r == C) {
+          if(k == 1) return 1;
+        } else if(r < N && r >= S) { // jumps of 2, and Lion-like moves
+          if(k == 2) return 1;
+          if(r < J) {
+            if(k == 1) return 1;
+            if(r < I) {
+              if(r >= T) { if(k == 3 || r == K && !last) return 1; }
+              else if(r < L && !last && k <= (r == S ? 36 : 3)) return 1;
+            }
+          }
+        }
+      }
+      if(i != EMPTY) { last = y; if(p[i].qval > bar) bar = p[i].qval; }
+      if(last && k >= 3 && !tenFlag) break; // nothing beyond can get past it
+    }
+  }
+  for(j=0; j<RAYS; j++) { // Knight jumps (also part of the true Lion move)
+    i = board[sqr - nStep[j]];
+    if(i != EMPTY && i != EDGE && (i & TYPE) == c) {
+      r = p[i].range[j];
+      if(r == N || r <= L && r >= S && r != W) return 1;
+    }
+  }
+  return 0;
+}
+
 int
 MakeMove (Color stm, Move m, UndoInfo *u)
 {
@@ -305,6 +476,7 @@ MakeMove (Color stm, Move m, UndoInfo *u)
   memset(u->epVictim, EMPTY, (RAYS+1)*sizeof(int));
   u->saveDelta = promoDelta;
   u->filling = filling;
+  u->men = men;
 
   if(p[u->piece].promoFlag & LAST_RANK) cnt50 = 0; // forward piece: move is irreversible
   // TODO: put in some test for forward moves of non-backward pieces?
@@ -364,6 +536,7 @@ MakeMove (Color stm, Move m, UndoInfo *u)
     promoDelta += p[u->epVictim[1]].promoGain;
     filling  -= p[u->epVictim[0]].bulk;
     filling  -= p[u->epVictim[1]].bulk;
+    men -= (u->epVictim[0] != EMPTY) + (u->epVictim[1] != EMPTY);
     hashKeyL ^= p[u->epVictim[0]].pieceKey * squareKey[u->epSquare];
     hashKeyH ^= p[u->epVictim[0]].pieceKey * squareKey[u->epSquare + STEP(1, 0)];
     hashKeyL ^= p[u->epVictim[1]].pieceKey * squareKey[u->ep2Square];
@@ -391,7 +564,7 @@ MakeMove (Color stm, Move m, UndoInfo *u)
 	  u->booty += p[burnVictim].value + PSQ(p[burnVictim].pst, x, BLACK);
 	  u->gain  += p[burnVictim].value;
 	  promoDelta += p[burnVictim].promoGain;
-	  filling  -= p[burnVictim].bulk;
+	  filling  -= p[burnVictim].bulk; men--;
 	  hashKeyL ^= p[burnVictim].pieceKey * squareKey[x];
 	  hashKeyH ^= p[burnVictim].pieceKey * squareKey[x + STEP(1, 0)];
 	  cnt50 = 0; // actually burning something makes the move irreversible
@@ -413,6 +586,7 @@ MakeMove (Color stm, Move m, UndoInfo *u)
   u->booty += PSQ(p[u->new].pst, u->to, BLACK) - PSQ(p[u->piece].pst, u->from, BLACK);
 
   filling += p[u->new].bulk - p[u->piece].bulk - p[u->victim].bulk;
+  men -= (u->victim != EMPTY) + (u->new == EMPTY);
   promoDelta += p[u->new].promoGain - p[u->piece].promoGain + p[u->victim].promoGain;
   u->booty += p[u->victim].value + PSQ(p[u->victim].pst, u->to, BLACK);
   u->gain  += p[u->victim].value;
@@ -431,6 +605,7 @@ MakeMove (Color stm, Move m, UndoInfo *u)
   hashKeyH ^= p[u->new].pieceKey * squareKey[u->to + STEP(1, 0)]
            ^  p[u->piece].pieceKey * squareKey[u->from + STEP(1, 0)]
            ^  p[u->victim].pieceKey * squareKey[u->to + STEP(1, 0)];
+  if(tenFlag) ReBarrier(u);
 
   return deferred;
 }
@@ -471,7 +646,9 @@ UnMake (UndoInfo *u)
   hashKeyL = u->savKeyL;
   hashKeyH = u->savKeyH;
   filling  = u->filling;
+  men      = u->men;
   promoDelta = u->saveDelta;
+  if(tenFlag) ReBarrier(u);
 }
 	
 void
@@ -11,18 +11,21 @@
 Flag IsEmpty(int sqr);
 void SetUp(char *fen, char *IDs, int var);
 void StackMultis(Color c);
+void MapBarriers();
+int WalkBarrier(int c, int dir, int sqr);
 int PSTest();
 int Dtest();
 int MapAttacksByColor(Color color, int pieces, int level);
 int MapAttacks(int level);
+int SquareAttacked(int sqr, Color c);
 int MakeMove(Color stm, Move m, UndoInfo *u);
 void UnMake(UndoInfo *u);
 void pboard(int *b);
 void pbytes(Flag *b);
 void pmap(Color c);
 
-extern VariantDesc *variant;
-extern int bFiles, bRanks, zone, currentVariant, repDraws, stalemate;
+extern THREAD VariantDesc *variant;
+extern THREAD int bFiles, bRanks, zone, currentVariant, repDraws, stalemate;
 #define chessFlag (currentVariant == V_CHESS || currentVariant == V_LION || currentVariant == V_WOLF)
 #define chuFlag (currentVariant == V_CHU || currentVariant == V_LION)
 #define makrukFlag (currentVariant == V_MAKRUK)
@@ -30,10 +33,10 @@ extern int bFiles, bRanks, zone, currentVariant, repDraws, stalemate;
 #define tenFlag (currentVariant == V_TENJIKU)
 #define wolfFlag (currentVariant == V_WOLF)
 
-extern int framePtr;
-extern int level, cnt50;
+extern THREAD int framePtr;
+extern THREAD int level, cnt50;
 
-extern Flag fireFlags[10]; // flags for Fire-Demon presence (last two are dummies, which stay 0, for compactify)
+extern THREAD Flag fireFlags[10]; // flags for Fire-Demon presence (last two are dummies, which stay 0, for compactify)
 
 //                                           Main Data structures
 //
@@ -44,10 +47,10 @@ extern Flag fireFlags[10]; // flags for Fire-Demon presence (last two are dummie
 //   (If there are attacks by range-jumpers, the 3-bit count is increased by 2 over the actual value)
 
 // Board:
-//   The board has twice as many files as actually used, in 0x88 fashion
+//   The board is centered in a BW x BH mailbox
 //   The used squares hold the piece numbers (for use as index in the piece list)
 //   Unused squares are set to the invalid piece number EDGE
-//   There are also 3 guard ranks of EDGE on each side
+//   These give at least 2 guard ranks and files on each side, so no jump leaves the mailbox
 
 // Moves:
 //   Moves are encoded as 11-bit from-square and to-square numbers packed in the low bits of an int
@@ -59,7 +62,7 @@ extern Flag fireFlags[10]; // flags for Fire-Demon presence (last two are dummie
 //   8-bit draft of each of those scores, an age counter that stores the search number of the last access.
 //   The hash key is derived as the XOR of the products pieceKey[piece]*squareKey[square].
 
-extern int board[BSIZE];
+extern THREAD int board[BSIZE];
 // Stockfish and many engines compute attacks on demand using magic bitboards
 // whereas HaChu attempts in vain to maintain "this square attacks these rays"
 // further compounded by "level" (search depth).
@@ -71,8 +74,21 @@ extern int board[BSIZE];
 // The question of "what squares does my piece attack?" could benefit from a map
 // of squares to PieceDesc (or range) however "is a square attacked?" might not.
 #define LEVELS 200
-extern int attacksByLevel[LEVELS][COLORS][BSIZE];
+extern THREAD int attacksByLevel[LEVELS][COLORS][BSIZE];
 #define attacks attacksByLevel[level]
 #define ATTACK(pos, color) attacks[color][pos]
-extern Flag fireBoard[BSIZE];    // flags to indicate squares controlled by Fire Demons
+extern THREAD Flag fireBoard[BSIZE];    // flags to indicate squares controlled by Fire Demons
+
+// Jump barriers:
+//   Tenjiku range jumpers (qval 1-3) jump over everything of lower rank, so only pieces with a non-zero qval
+//   (and the board edge) can stop them. For every rank, ray and square jumpStop holds the nearest square
+//   behind it (in the direction of the ray) that a jumper of that rank cannot pass. As ranked pieces are few,
+//   MakeMove and UnMake only have to re-sweep the lines through squares where a ranked piece came or went.
+#define RANKS 4 /* jump-capture ranks a range jumper can have (0 = no jumper) */
+extern THREAD int jumpStop[RANKS][RAYS][BSIZE];
+#ifdef NO_JUMP_TABLE
+#define JUMPSTOP(c, dir, sqr) WalkBarrier(c, dir, sqr) /* step to the barrier (reference build for 'make check') */
+#else
+#define JUMPSTOP(c, dir, sqr) jumpStop[c][dir][sqr]
+#endif
 #endif
@@ -0,0 +1,195 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Thin line-protocol driver on top of libhachu: one game per session, one reply line per command.
+//   new VARIANT | setboard FEN | move MOVE | undo [N] | moves | option NAME=VALUE
+//   memory MB  (hash table of the session; 0 = use that of the thread searching it)
+//   go [depth=N] [nodes=N] [ms=N]  ->  bestmove MOVE [ponder MOVE] score N  (bestmove none when there is no move)
+//   quit
+// Usage: hachud [-s SOCKET] [-t THREADS] [-m MB]
+// Without -s there is a single session on stdin/stdout. With -s it is a daemon listening on a Unix socket,
+// every connection being a session; complete command lines of all sessions are executed by a pool of
+// THREADS workers (default 4), and every session starts with its own hash table of MB megabytes (default 16).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libhachu.h"
+
+int defaultMB = 16; // hash size of new sessions
+
+int
+Command (HachuGame **g, int *mb, char *line, char *reply, int size)
+{ // execute one command line for the session with game *g; 0 means the session ends
+  char cmd[20], arg[8000], move[80], ponder[80];
+  char *q = strchr(line, '\n');
+  if(q) *q = 0;
+  *cmd = *arg = 0; sscanf(line, "%19s %7999[^\n]", cmd, arg);
+  if(!strcmp(cmd, "quit")) return 0;
+  if(!strcmp(cmd, "new")) {
+    HachuGame *h = hachu_new(*arg ? arg : "chu");
+    if(!h) { snprintf(reply, size, "error unknown variant\n"); return 1; }
+    hachu_free(*g); *g = h;
+    snprintf(reply, size, hachu_hash(h, *mb) ? "error no memory\n" : "ok\n");
+  } else if(!strcmp(cmd, "setboard")) snprintf(reply, size, hachu_setboard(*g, arg) ? "error invalid position\n" : "ok\n");
+  else if(!strcmp(cmd, "move"))    snprintf(reply, size, hachu_move(*g, arg) ? "error illegal move\n" : "ok\n");
+  else if(!strcmp(cmd, "undo"))    snprintf(reply, size, "ok %d\n", hachu_undo(*g, *arg ? atoi(arg) : 1));
+  else if(!strcmp(cmd, "option"))  snprintf(reply, size, hachu_option(*g, arg) ? "error unknown option\n" : "ok\n");
+  else if(!strcmp(cmd, "memory"))  snprintf(reply, size, hachu_hash(*g, *mb = atoi(arg)) ? "error no memory\n" : "ok\n");
+  else if(!strcmp(cmd, "moves"))   snprintf(reply, size, hachu_moves(*g, arg, sizeof(arg)) < 0 ? "error invalid position\n" : "moves %s\n", arg);
+  else if(!strcmp(cmd, "go")) {
+    int depth = 0, nodes = 0, ms = 0, score, len;
+    char *tok;
+    for(tok=strtok(arg, " "); tok; tok=strtok(NULL, " "))
+      sscanf(tok, "depth=%d", &depth), sscanf(tok, "nodes=%d", &nodes), sscanf(tok, "ms=%d", &ms);
+    score = hachu_search(*g, depth, nodes, ms, move, ponder);
+    if(score == HACHU_FAIL) { snprintf(reply, size, "error invalid position\n"); return 1; }
+    len = snprintf(reply, size, "bestmove %s", *move ? move : "none");
+    if(*ponder) len += snprintf(reply + len, size - len, " ponder %s", ponder);
+    snprintf(reply + len, size - len, " score %d\n", score);
+  } else snprintf(reply, size, "error unknown command\n");
+  return 1;
+}
+
+HachuGame *
+NewGame (int mb)
+{
+  HachuGame *g = hachu_new("chu");
+  if(g && hachu_hash(g, mb)) hachu_free(g), g = NULL;
+  return g;
+}
+
+void
+Serve (FILE *in, FILE *out)
+{ // play one game with commands read from in, replies to out
+  HachuGame *g = NewGame(defaultMB);
+  char line[8000], reply[8000];
+  int mb = defaultMB;
+  if(!g) { fprintf(out, "error no memory\n"); return; }
+  while(fgets(line, sizeof(line), in) && Command(&g, &mb, line, reply, sizeof(reply))) fputs(reply, out), fflush(out);
+  hachu_free(g);
+}
+
+#ifndef WIN32
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAXSESSIONS 1000
+
+typedef struct Session {
+  int fd, busy, closing; // busy: in job queue or being served by a worker, which then owns it
+  HachuGame *g;
+  int mb, len;
+  char buf[8192];        // received text, of which the complete lines are commands
+  struct Session *next;  // in job queue
+} Session;
+
+Session *sessions[MAXSESSIONS], *jobFirst, *jobLast;
+int nrSessions, threadMB, wakeFd[2];
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t jobReady = PTHREAD_COND_INITIALIZER;
+
+void *
+Worker (void *arg)
+{ // execute all complete command lines of the sessions that get in the job queue
+  char reply[8000];
+  hachu_memory(threadMB); // for sessions that have no hash table of their own
+  for(;;) {
+    Session *s;
+    char *p, *q;
+    pthread_mutex_lock(&lock);
+    while(!jobFirst) pthread_cond_wait(&jobReady, &lock);
+    s = jobFirst; if(!(jobFirst = s->next)) jobLast = NULL;
+    pthread_mutex_unlock(&lock);
+    for(p=s->buf; !s->closing && (q = memchr(p, '\n', s->buf + s->len - p)); p = q + 1) {
+      *q = 0;
+      if(!Command(&s->g, &s->mb, p, reply, sizeof(reply)) || write(s->fd, reply, strlen(reply)) < 0) s->closing = 1;
+    }
+    s->len -= p - s->buf; memmove(s->buf, p, s->len);
+    pthread_mutex_lock(&lock);
+    s->busy = 0;
+    pthread_mutex_unlock(&lock);
+    if(write(wakeFd[1], "", 1) < 0) perror("wake"); // main thread must poll the session again
+  }
+  return NULL;
+}
+
+int
+Daemon (char *path, int threads)
+{ // accept sessions on Unix socket, and hand the command lines they send to the worker threads
+  static struct pollfd fds[MAXSESSIONS+2];
+  static Session *polled[MAXSESSIONS+2];
+  struct sockaddr_un addr;
+  pthread_t t;
+  int lfd, i, n;
+  signal(SIGPIPE, SIG_IGN); // a client that goes away only ends its own session
+  memset(&addr, 0, sizeof(addr)); addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  unlink(path);
+  if((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+     listen(lfd, 64) || pipe(wakeFd)) { perror(path); return 1; }
+  threadMB = (defaultMB ? 1 : 64); // the thread tables only serve sessions that asked for 'memory 0'
+  for(i=0; i<threads; i++) if(pthread_create(&t, NULL, Worker, NULL)) { perror("thread"); return 1; }
+  for(;;) {
+    fds[0].fd = lfd; fds[1].fd = wakeFd[0]; fds[0].events = fds[1].events = POLLIN; n = 2;
+    pthread_mutex_lock(&lock);
+    for(i=0; i<nrSessions; i++) {
+      Session *s = sessions[i];
+      if(s->busy) continue; // a worker owns it
+      if(s->closing) { close(s->fd); hachu_free(s->g); free(s); sessions[i--] = sessions[--nrSessions]; continue; }
+      fds[n].fd = s->fd; fds[n].events = POLLIN; polled[n++] = s;
+    }
+    pthread_mutex_unlock(&lock);
+    if(poll(fds, n, -1) < 0) { if(errno == EINTR) continue; perror("poll"); return 1; }
+    if(fds[1].revents) { char c[64]; if(read(wakeFd[0], c, sizeof(c)) < 0) perror("wake"); }
+    if(fds[0].revents) {
+      int fd = accept(lfd, NULL, NULL);
+      Session *s = NULL;
+      if(fd >= 0 && (nrSessions >= MAXSESSIONS || !(s = calloc(1, sizeof(Session))) || !(s->g = NewGame(defaultMB))))
+        free(s), close(fd), s = NULL; // refused
+      if(s) s->fd = fd, s->mb = defaultMB, sessions[nrSessions++] = s;
+    }
+    for(i=2; i<n; i++) if(fds[i].revents) {
+      Session *s = polled[i];
+      int r = read(s->fd, s->buf + s->len, sizeof(s->buf) - s->len);
+      if(r <= 0) { s->closing = 1; continue; } // client hung up
+      s->len += r;
+      if(!memchr(s->buf + s->len - r, '\n', r)) { // no new complete line
+        if(s->len == sizeof(s->buf)) s->closing = 1; // and never will be
+        continue;
+      }
+      pthread_mutex_lock(&lock);
+      s->busy = 1; s->next = NULL;
+      if(jobLast) jobLast->next = s; else jobFirst = s;
+      jobLast = s;
+      pthread_cond_signal(&jobReady);
+      pthread_mutex_unlock(&lock);
+    }
+  }
+}
+#endif
+
+int
+main (int argc, char **argv)
+{
+  char *path = NULL;
+  int i, threads = 4;
+  for(i=1; i<argc-1; i++) {
+    if(!strcmp(argv[i], "-s")) path = argv[++i];
+    else if(!strcmp(argv[i], "-t")) threads = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-m")) defaultMB = atoi(argv[++i]);
+  }
+#ifndef WIN32
+  if(path) return Daemon(path, threads < 1 ? 1 : threads);
+#endif
+  Serve(stdin, stdout);
+  return 0;
+}
@@ -15,24 +15,33 @@
 #define FORTRESS
 #define PAWNBLOCK
 #define TANDEM 100 /* bonus for pairs of attacking light steppers */
+#define LAZY (512 >> 3) /* bound on the King-shield term, the only one skipped by lazy evaluation */
 #define PROMO 0 /* extra bonus for 'vertical' piece when it actually promotes (diagonal pieces get half) */
 
-signed char psq[PSTSIZE][BSIZE] = { 0 }; // cache of piece-value-per-square
+THREAD signed char psq[PSTSIZE][BSIZE] = { 0 }; // cache of piece-value-per-square
 
-HashKey hashKeyH=1, hashKeyL=1;
-int rootEval, filling, promoDelta;
-int mobilityScore;
+THREAD HashKey hashKeyH=1, hashKeyL=1;
+THREAD int rootEval, filling, promoDelta, men;
+THREAD int mobilityScore;
+THREAD EvalEntry evalCache[EVALCACHE];
+#ifdef STATS
+THREAD int evalProbes, evalHits, lazyCnt;
+#endif
 
 int
-Evaluate (Color c, int tsume, int difEval)
-{
+Evaluate (Color c, int tsume, int difEval, int alpha, int beta)
+{ // alpha-beta window allows lazy evaluation; pass an infinite window for exact score
   int wLion=ABSENT, bLion=ABSENT, score=mobilityScore, f;
+  EvalEntry *e = evalCache + ((hashKeyL ^ 0x9E3779B9*c) & EVALCACHE-1);
 #ifdef KINGSAFETY
   int wKing, bKing, i, j, max=512;
 #endif
 
   if(tsume) return difEval;
 
+  STAT(evalProbes++;)
+  if(e->lock == (hashKeyH ^ c)) { STAT(evalHits++;) return difEval + e->eval; } // position evaluated before
+
   if(LION(WHITE+2)) wLion = p[WHITE+2].pos;
   if(LION(BLACK+2)) bLion = p[BLACK+2].pos;
   if(wLion == ABSENT && LION(WHITE+4)) wLion = p[WHITE+4].pos;
@@ -74,17 +83,15 @@ Evaluate (Color c, int tsume, int difEval)
     if(lead < -100) score += PSQ(PST_CENTER, wKing, WHITE)*(32 - filling) >> 3; // black leads, drive white K to corner
     max = 16*filling;
   }
+#endif
 
+#ifdef KINGSAFETY
 #ifdef FORTRESS
   f = 0;
   if(bLion != ABSENT) f += Fortress( BW, wKing, bLion);
   if(wLion != ABSENT) f -= Fortress(-BW, bKing, wLion);
   score += (filling < 192 ? f : f*(224 - filling) >> 5); // build up slowly
 #endif
-
-#ifdef KSHIELD
-  if(wKing && bKing) score += Surround(WHITE, wKing, 1, max) - Surround(BLACK, bKing, 1, max) >> 3;
-#endif
 #endif
 
 #if KYLIN
@@ -142,7 +149,22 @@ Evaluate (Color c, int tsume, int difEval)
     }
 #endif
 
-  return difEval - (filling*promoDelta >> 8) + (c ? score : -score);
+#ifdef LAZY
+  // only the King shield is left: two Surround() calls, each capped at max <= 512, so it cannot exceed LAZY
+  f = difEval + (c ? score : -score) - (filling*promoDelta >> 8);
+  if(f - LAZY >= beta) { STAT(lazyCnt++;) return f - LAZY; } // return bound, not stored in cache
+  if(f + LAZY <= alpha) { STAT(lazyCnt++;) return f + LAZY; }
+#endif
+
+#ifdef KINGSAFETY
+#ifdef KSHIELD
+  if(wKing && bKing) score += Surround(WHITE, wKing, 1, max) - Surround(BLACK, bKing, 1, max) >> 3;
+#endif
+#endif
+
+  e->lock = hashKeyH ^ c;
+  e->eval = (c ? score : -score) - (filling*promoDelta >> 8); // the part not updated incrementally
+  return difEval + e->eval;
 }
 
 int
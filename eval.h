@@ -25,13 +25,14 @@
 #define PST_LANCE   11
 #define PSTSIZE     12 // number of PST types
 
-extern signed char psq[PSTSIZE][BSIZE]; // cache of piece-value-per-square
+extern THREAD signed char psq[PSTSIZE][BSIZE]; // cache of piece-value-per-square
 #define PSQ(type, sq, color) psq[type][color == BLACK ? sq : BSIZE-sq-1]
 
 typedef unsigned int HashKey;
-extern HashKey hashKeyH, hashKeyL;
-extern int rootEval, filling, promoDelta;
-extern int mobilityScore;
+extern THREAD HashKey hashKeyH, hashKeyL;
+extern THREAD int rootEval, filling, promoDelta;
+extern THREAD int men; // number of pieces on board (filling only counts bulky ones)
+extern THREAD int mobilityScore;
 
 typedef struct {
   int lock[5];
@@ -53,7 +54,19 @@ typedef struct {
   char age;
 } HashEntry; // hash-table entry
 
-int Evaluate(Color c, int tsume, int difEval);
+#define EVALCACHE 65536 /* entries in direct-mapped eval cache */
+
+typedef struct {
+  HashKey lock;
+  int eval; // Evaluate() minus difEval
+} EvalEntry;
+
+extern THREAD EvalEntry evalCache[EVALCACHE];
+#ifdef STATS
+extern THREAD int evalProbes, evalHits, lazyCnt;
+#endif
+
+int Evaluate(Color c, int tsume, int difEval, int alpha, int beta);
 int Surround(Color c, int king, int start, int max);
 int Fortress(int forward, int king, int lion);
 int Ftest(int side);
@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include <signal.h>
 #include <stdint.h>
@@ -16,18 +17,23 @@
 #include "board.h"
 #include "eval.h"
 #include "hachu.h"
+#include "mcts.h"
 #include "move.h"
 #include "piece.h"
+#include "tb.h"
+#include "trace.h"
 #include "types.h"
 #include "variant.h"
 
 #define HASH
 #define KILLERS
+#define HISTORY 1023
 #define NULLMOVE
 #define CHECKEXT
 #define LMR 4
-#define PATH 0
 #define QSDEPTH 4
+#define ASPIRATION 30
+#define FUTILITY
 
 #define INF 8000
 
@@ -35,6 +41,14 @@
 #define H_LOWER 1
 #define FIFTY 50
 #define LEVELS 200
+#define QSHASH 4096 /* buckets in separate quiescence hash table (256KB) */
+#define REP_FILTER 4095 /* mask for low hash bits indexing repetition filter */
+#ifdef NO_REP_FILTER
+#define REP_SEEN(key) 1 /* always scan (reference build for 'make check') */
+#else
+#define REP_SEEN(key) repFilter[(key) & REP_FILTER]
+#endif
+//#define TRACE 1048576 /* records in search-trace ring buffer (power of 2), saved by 'trace' command */
 
 #ifdef WIN32
 #include <windows.h>
@@ -51,6 +65,8 @@
 #else
 #include <sys/time.h>
 #include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
      int InputWaiting()
      {
         int cnt;
@@ -65,27 +81,111 @@
      }
 #endif
 
-HashBucket *hashTable;
-int hashMask;
+THREAD HashBucket *hashTable, *qsTable; // main and quiescence hash table
+THREAD int hashMask;
 
-char abortFlag, fenArray[4000], startPos[4000];
-int nonCapts, retFirst, retMSP, retDep, pvPtr;
-int nodes, startTime, lastRootMove, lastRootIter, tlim1, tlim2, tlim3, comp;
-Move ponderMove;
-Move retMove, moveStack[20000], variation[FIFTY*COLORS], repStack[LEVELS+(FIFTY*COLORS)], pv[1000], repeatMove[LEVELS+(FIFTY*COLORS)], killer[FIFTY*COLORS][2];
-Flag checkStack[LEVELS+(FIFTY*COLORS)];
+THREAD char abortFlag, fenArray[4000], startPos[4000];
+THREAD int nonCapts, retFirst, retMSP, retDep, pvPtr;
+THREAD int nodes, nodeLimit, startTime, lastRootMove, lastRootIter, tlim1, tlim2, tlim3, comp;
+THREAD Move ponderMove;
+THREAD Move retMove, moveStack[30000], variation[FIFTY*COLORS], repStack[LEVELS+(FIFTY*COLORS)], pv[1000], repeatMove[LEVELS+(FIFTY*COLORS)], killer[FIFTY*COLORS][2];
+THREAD Flag checkStack[LEVELS+(FIFTY*COLORS)];
 
-int level, maxDepth; // used by search
+THREAD int level, maxDepth; // used by search
 
 // Parameters that control search behavior
-int ponder;
-int randomize;
-int postThinking;
-int noCut=1;        // engine-defined option
-int resign;         // engine-defined option
-int contemptFactor; // likewise
-int seed;
-int tsume, pvCuts, allowRep, entryProm=1, okazaki;
+THREAD int ponder;
+THREAD int ponderReplies=1;        // engine-defined option: number of likely opponent replies to ponder on
+THREAD int ponderDepth;            // depth of current round when pondering on several replies (0 = no rounds)
+THREAD int ponderCnt, ponderHits, ponderSaved, ponderHitTime; // opponent moves during pondering, predicted ones, ms pondered on those
+THREAD int randomize;
+THREAD int postThinking;
+THREAD int noCut=1;        // engine-defined option
+THREAD int resign;         // engine-defined option
+THREAD int contemptFactor; // likewise
+THREAD int seed;
+THREAD int tsume, pvCuts, allowRep, entryProm=1, okazaki, qsChecks;
+THREAD int pruneScale=100; // engine-defined option: forward-pruning margins in %, 0 = off
+THREAD int futMargin[3], razorMargin, lmpCount[4]; // per-variant pruning parameters, indexed by remaining depth
+THREAD int nullR=3, verifyDepth=8; // engine-defined options: null-move reduction, remaining depth from which null cutoffs are verified
+THREAD int nullUnit;               // eval excess over beta that buys an extra ply of null-move reduction
+THREAD short repFilter[REP_FILTER+1]; // counts positions on repStack (game and current line) per low bits of hashKeyH
+THREAD int rootDepth;               // depth of last root iteration
+THREAD char testMoves[2][200];      // EPD bm and am moves of batch test position, as " m1 m2 ... "
+THREAD int solveTime, solveDepth;   // since when the best move solves the test position (-1 = not solved)
+#ifndef LIBHACHU
+jmp_buf fatalJump;                  // FATAL() returns here instead of exiting while fatalCatch is set
+int fatalCatch;
+#endif
+
+#ifdef STATS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICKS() __rdtsc()
+#else
+#define TICKS() (unsigned long long) clock()
+#endif
+#define T_MAP     0
+#define T_CAPT    1
+#define T_NONCAPT 2
+#define T_MAKE    3
+#define T_UNMAKE  4
+#define T_EVAL    5
+#define T_HASH    6
+#define T_NR      7
+char *timerName[] = { "MapAttacks", "GenCapts", "GenNonCapts", "MakeMove", "UnMake", "Evaluate", "LookupHashMove" };
+THREAD unsigned long long timerTicks[T_NR], statStart, searchTicks;
+THREAD int timerCalls[T_NR], hashHits, hashMisses, hashCuts, phaseCuts[10], firstCuts, standPatCuts, nodeCnt[2];
+THREAD int futileCnt, lmpCnt, razorCnt;  // nodes pruned by each method
+THREAD int nullCnt, verifyCnt, zugCnt;
+THREAD int repProbes, repScans;          // repetition checks, and how many the filter let through to a scan
+#define TIMED(t, x) (statStart = TICKS(), x, timerTicks[t] += TICKS() - statStart, timerCalls[t]++)
+#else
+#define TIMED(t, x) x
+#endif
+
+#ifdef TRACE
+THREAD TraceRecord traceBuf[TRACE];
+THREAD unsigned int traceCnt; // records written in current search; ring position is traceCnt & TRACE-1
+#define TRACE_NODE(m, a, b, s, d, ph, f) { TraceRecord *t = traceBuf + (traceCnt++ & TRACE-1); \
+  t->move = m; t->alpha = a; t->beta = b; t->score = s; t->level = level; t->depth = (d) - QSDEPTH; t->phase = ph; t->flags = f; }
+#else
+#define TRACE_NODE(m, a, b, s, d, ph, f)
+#endif
+#ifdef HISTORY
+THREAD int history[NPIECES][1<<SQLEN];             // success of quiet moves per piece type (p[].kind) and to-square, +/- HISTORY
+THREAD Move counterMove[BSIZE][1<<SQLEN];          // quiet refutation of opponent move, by its from-square and to-field
+THREAD Move followMove[BSIZE][1<<SQLEN];           // quiet move that worked after our own previous move
+
+static inline void
+UpdateHistory (Move move, int bonus)
+{ // gravity update keeps entries in [-HISTORY, HISTORY]
+  int *h = &history[p[board[FROM(move)]].kind][move & SQUARE];
+  *h += bonus - *h * (bonus < 0 ? -bonus : bonus) / HISTORY;
+}
+
+static inline Move
+QuietKey (Move move, Move counter, Move follow)
+{ // sort key for non-capture: promotions first, then by history, with bonus for counter and follow-up move
+  int key;
+  if(move & PROMOTE) return move | (Move) 4095 << KEYSHIFT;
+  key = history[p[board[FROM(move)]].kind][move & SQUARE] + HISTORY + 1;
+  if(move == counter) key += 1024;
+  if(move == follow)  key += 512;
+  return move | (Move) key << KEYSHIFT;
+}
+#endif
+
+void
+ClearHistory ()
+{ // forget killers and move-ordering statistics gathered in another game
+  memset(killer, 0, sizeof(killer));
+#ifdef HISTORY
+  memset(history, 0, sizeof(history));
+  memset(counterMove, 0, sizeof(counterMove));
+  memset(followMove, 0, sizeof(followMove));
+#endif
+}
 
 static inline int
 PromotionFlags (Move move)
@@ -244,7 +344,7 @@ printf("GenCapts(%c%d,%d) %08x\n", FILECH(sqr), RANK(sqr), victimValue, att);
 #endif
   if(!att) return msp; // no attackers at all!
   for(i=0; i<RAYS; i++) {            // try all rays
-    int x, v, jcapt=0;
+    int x, v;
     if(att & attackMask[i]) {        // attacked by move in this direction
       v = -kStep[i]; x = sqr;
       while(IsEmpty(x+=v)); // scan towards source until we encounter a 'stop'
@@ -262,7 +362,6 @@ printf("  attacker %d, range %d, dist %d\n", attacker, r, d);
           msp = NewCapture(x, sqr + victimValue - SORTKEY(attacker), p[attacker].promoFlag, msp);
           att -= ray[i];
           if(!(att & attackMask[i])) continue; // no more; next direction
-          jcapt = p[board[x]].qval;   // jump-capturer hierarchy
           while(IsEmpty(x+=v));// one attack accounted for, but more to come, so skip to next stop
         }
       }
@@ -271,12 +370,12 @@ printf("  attacker %d, range %d, dist %d\n", attacker, r, d);
       while(board[x] != EDGE) {
 #if 0
 printf("   scan %x-%x (%3d) dir=%d d=%d", sqr, x, board[x], i, dist(x, sqr)); fflush(stdout);
-printf(" r=%d att=%o jcapt=%d qval=%d\n", p[board[x]].range[i], att, jcapt, p[board[x]].qval);
+printf(" r=%d att=%o qval=%d\n", p[board[x]].range[i], att, p[board[x]].qval);
 #endif
       if((board[x] & TYPE) == stm) {   // stop is ours
-        int attacker = board[x], d = dist(x, sqr), r = p[attacker].range[i];
-        if(jcapt < p[attacker].qval) { // it is a range jumper that jumps over the barrier
-          if(p[attacker].range[i] > 1) { // assumes all jump-captures are infinite range
+        int attacker = board[x], d = dist(x, sqr), r = p[attacker].range[i], c = p[attacker].qval;
+        if(c) { // ranked piece: it attacks when the first thing it cannot jump over is not before us
+          if(r > 1 && dist(x, JUMPSTOP(c, i, x)) >= d) { // assumes all jump-captures are infinite range
             msp = NewCapture(x, sqr, p[attacker].promoFlag, msp);
             att -= ray[i];
           }
@@ -391,7 +490,6 @@ if(board[x] == EDGE) { printf("    edge hit %x-%x dir=%d att=%o\n", sqr, x, i, a
         if((att & attackMask[i]) == 0) break;
       }
       // more attacks to come; scan for next stop
-      if(jcapt < p[board[x]].qval) jcapt = p[board[x]].qval; // raise barrier for range jumpers further upstream
       while(IsEmpty(x+=v)); // this should never run off-board, if the attack map is not corrupted
       }
     }
@@ -423,53 +521,261 @@ FireSet (Color c, UndoInfo *tb)
     if(p[i].pos != ABSENT) tb->fireMask |= fireFlags[i-2];
 }
 
+THREAD int checkMark[BSIZE], lineMark[BSIZE], checkStamp; // king-relative tables for CheckFilter
+
+int
+CheckFilter (Color stm, int first, int msp)
+{ // compact the moves from first on to those that check the opponent royal (directly or by discovery)
+  int i, j, k, y, n;
+  Color c = INVERT(stm);
+  Move move;
+  UndoInfo tb;
+  k = p[royal[c]].pos;
+  if(k == ABSENT) k = p[royal[c] + 2].pos;
+  else if(p[royal[c] + 2].pos != ABSENT) return first; // two kings is no king...
+  if(k == ABSENT) return first;
+  checkStamp++; // mark squares a checker can stand on, and occupied squares a discovery could uncover
+  for(j=0; j<RAYS; j++) {
+    checkMark[k + nStep[j]] = checkStamp;
+    for(y=k+kStep[j]; board[y] != EDGE; y+=kStep[j]) {
+      checkMark[y] = checkStamp;
+      if(board[y] != EMPTY) lineMark[y] = checkStamp;
+    }
+  }
+  tb.fireMask = 0;
+  if(tenFlag) FireSet(stm, &tb);
+  for(i=n=first; i<msp; i++) { // keep the candidates the tables allow, and verify those
+    MoveInfo info = MoveToInfo(move = moveStack[i]);
+    if(i == nonCapts) nonCapts = n; // keep pointing to the first non-capture
+    if(checkMark[info.to] != checkStamp && lineMark[info.from] != checkStamp && !DEMON(board[info.from]) &&
+       (info.path[0] == ABSENT || lineMark[info.path[0]] != checkStamp) &&
+       (info.path[1] == ABSENT || lineMark[info.path[1]] != checkStamp)) continue;
+    MakeMove(c, move, &tb);
+    j = InCheck(c);
+    UnMake(&tb);
+    if(j) moveStack[n++] = move;
+  }
+  return n;
+}
+
+int
+GenChecks (Color stm, Move promoSuppress, int msp, int captures)
+{ // generate only checking moves (with captures = 0 only the non-captures), for tsume and QS checks
+  int i, first = msp;
+  Move nullMove;
+  if(captures) for(i=INVERT(stm)+2; i<=pieces[INVERT(stm)]; i+=2) { // captures, for all victims
+    int to = p[i].pos;
+    if(to == ABSENT || !ATTACK(to, stm)) continue;
+    msp = GenCapts(stm, to, 0, msp);
+  }
+  nonCapts = msp;
+  msp = GenNonCapts(stm, promoSuppress, msp, &nullMove);
+  return CheckFilter(stm, first, msp);
+}
+
 char TerminationCheck(Color stm);
 
+static int
+LionTrade (Color stm, Move move, Move promoSuppress)
+{ // decide before making it whether a capture violates the Chu Lion-trade rules (1 = illegal)
+  int from = FROM(move), to = move & SQUARE, ep = from, ep2 = from, piece = board[from], c = INVERT(stm), res;
+  if(to >= SPECIAL) {
+    if(to >= CASTLE) return 0;
+    ep  = from + epList[to - SPECIAL];
+    ep2 = from + ep2List[to - SPECIAL];
+    to  = from + toList[to - SPECIAL];
+  }
+  board[from] = EMPTY; // mover leaves first, so that igui does not see itself as victim
+  if(!LION(board[to]) && !LION(board[ep])) { board[from] = piece; return 0; }
+  if(LION(piece)) {    // Ln x Ln: distant capture of protected Lion, unless a bridge > GB was taken
+    res = dist(from, to) > 1 && p[board[ep]].value <= 50;
+  } else {             // other x Ln: illegal as counterstrike (or, with Okazaki rule, when protected)
+    res = (promoSuppress & PROMOTE) != 0;
+    if(res && !okazaki) { board[from] = piece; return 1; }
+  }
+  if(res && (board[ep] != EMPTY || board[ep2] != EMPTY || !ATTACK(to, c))) { // parent map not conclusive
+    int e = board[ep], e2 = board[ep2];
+    board[ep] = board[ep2] = EMPTY; // only removing our own victims can withdraw protection, and vacating opens lines
+    res = SquareAttacked(to, c);
+    board[ep2] = e2; board[ep] = e;
+  }
+  board[from] = piece;
+  return res;
+}
+
+static inline HashKey
+HashIndex (Color stm, Move oldPromo, Move promoSuppress, int mask)
+{ // bucket for current position; the promotion rights are part of the position
+  HashKey index = hashKeyL ^ 327*stm ^ (oldPromo + 987981)*(63121 + promoSuppress);
+  return index + (index >> 16) & mask;
+}
+
 Move
-LookupHashMove (Color stm, int alpha, int beta, int *depth, int *lmr, Move oldPromo, Move promoSuppress, int *bestMoveNr, int *bestScore, int *iterDep, int *resDep, HashKey *index, HashKey *hit)
+LookupHashMove (HashBucket *table, int mask, Color stm, int alpha, int beta, int *depth, int *lmr, Move oldPromo, Move promoSuppress, int *bestMoveNr, int *bestScore, int *iterDep, int *resDep, HashKey *index, HashKey *hit)
 {
   Move hashMove;
   HashKey nr = (hashKeyL >> 30) & 3; // top 2 bits of hashKeyL
-  *index = hashKeyL ^ 327*stm ^ (oldPromo + 987981)*(63121 + promoSuppress);
-  *index = *index + (*index >> 16) & hashMask;
-  if(hashTable[*index].lock[nr] == hashKeyH) *hit = nr;
-  else if(hashTable[*index].lock[4] == hashKeyH) *hit = 4;
+  *index = HashIndex(stm, oldPromo, promoSuppress, mask);
+  if(table[*index].lock[nr] == hashKeyH) *hit = nr;
+  else if(table[*index].lock[4] == hashKeyH) *hit = 4;
   else { // decide on replacement
-    if(*depth >= hashTable[*index].depth[nr] ||
-       *depth+1 == hashTable[*index].depth[nr] && (nodes % 4 == 0)) *hit = nr; else *hit = 4;
+    if(*depth >= table[*index].depth[nr] ||
+       *depth+1 == table[*index].depth[nr] && (nodes % 4 == 0)) *hit = nr; else *hit = 4;
+    if(*hit == 4 && *depth <= QSDEPTH && table[*index].depth[4] > QSDEPTH && table != qsTable) *hit = 5; // signal QS table is needed
+    STAT(hashMisses++;)
     return INVALID;
   }
 
-  *bestScore = hashTable[*index].score[*hit];
-  hashMove = hashTable[*index].move[*hit];
+  STAT(hashHits++;)
+  *bestScore = table[*index].score[*hit];
+  hashMove = table[*index].move[*hit];
 
-  if((*bestScore <= alpha || hashTable[*index].flag[*hit] & H_LOWER) &&
-     (*bestScore >= beta  || hashTable[*index].flag[*hit] & H_UPPER)   ) {
-    *iterDep = *resDep = hashTable[*index].depth[*hit];
+  if((*bestScore <= alpha || table[*index].flag[*hit] & H_LOWER) &&
+     (*bestScore >= beta  || table[*index].flag[*hit] & H_UPPER)   ) {
+    *iterDep = *resDep = table[*index].depth[*hit];
     *bestMoveNr = 0;
     if(!level) *iterDep = 0; // no hash cutoff in root
     if(*lmr && *bestScore <= alpha && *iterDep == *depth) ++*depth, --*lmr; // self-deepening LMR
     if(pvCuts && *iterDep >= *depth && hashMove && *bestScore < beta && *bestScore > alpha)
       *iterDep = *depth - 1; // prevent hash cut in PV node
-  }
+  } else if(*depth > QSDEPTH && table[*index].depth[*hit] > QSDEPTH && hashMove) // bound on wrong side (PVS re-search):
+    *iterDep = MIN(table[*index].depth[*hit], *depth) - 1;                      // resume deepening where it was
   return hashMove;
 }
 
-int
-Search (Color stm, int alpha, int beta, int difEval, int depth, int lmr, Move oldPromo, Move promoSuppress, int threshold, int msp)
-{
-  int i, j, k, king, defer, autoFail=0, late=100000, ep;
-  Flag inCheck=0;
-  int firstMove, curMove, sorted, bestMoveNr=0;
-  int resDep=0, iterDep, ext;
-  int myPV=pvPtr;
-  int score, bestScore=0, oldBest, curEval, iterAlpha;
-  Move move, nullMove=ABSENT;
+void
+SetMargins ()
+{ // forward-pruning margins scale with Pawn value and board size; move counts with board area
+  int i, m = (pVal ? pVal : 50) * (bFiles + bRanks) / 12 * pruneScale / 100;
+  futMargin[0] = 0; futMargin[1] = m; futMargin[2] = 3*m; razorMargin = 5*m;
+  nullUnit = 2*(pVal ? pVal : 50);
+  for(i=0; i<4; i++) lmpCount[i] = pruneScale ? bFiles*bRanks/8 * (i*i + 1) * pruneScale / 100 : 1000;
+}
+
+void
+CheckSolution ()
+{ // after root iteration of batch test position: remember when the best move became (and stayed) a solution
+  char buf[60];
+  sprintf(buf, " %s ", MoveToText(pv[0], 0));
+  if(pv[0] && (!*testMoves[0] || strstr(testMoves[0], buf)) && !strstr(testMoves[1], buf)) {
+    if(solveTime < 0) solveTime = lastRootIter, solveDepth = rootDepth;
+  } else solveTime = -1;
+}
+
+void
+PrintStats ()
+{ // dump hot-path counters of last search ('stats' command)
+  if(*tbPath) printf("# endgame tables: %d hits\n", tbHits);
+  MctsStats();
+  if(ponderCnt) printf("# ponder: %d hits of %d moves (%d%%), %d ms saved\n", ponderHits, ponderCnt, 100*ponderHits/ponderCnt, ponderSaved);
+#ifdef STATS
+  int i, cuts = 0;
+  printf("# nodes: %d full-width, %d QS\n", nodeCnt[1], nodeCnt[0]);
+  for(i=0; i<T_NR; i++)
+    printf("# %-15s %10d calls %12llu ticks %6.1f/call %5.1f%%\n", timerName[i], timerCalls[i], timerTicks[i],
+           timerCalls[i] ? (double) timerTicks[i]/timerCalls[i] : 0., searchTicks ? 100.*timerTicks[i]/searchTicks : 0.);
+  printf("# hash: %d hits, %d misses, %d cutoffs\n", hashHits, hashMisses, hashCuts);
+  printf("# cutoffs by phase (0 = list of earlier iteration):");
+  for(i=0; i<10; i++) printf(" %d", phaseCuts[i]), cuts += phaseCuts[i];
+  printf(" (%d%% by first move), stand pat %d\n", cuts ? (int) (100LL*firstCuts/cuts) : 0, standPatCuts);
+  printf("# pruned: futility %d, late moves %d, razoring %d, null move %d (verified %d, refuted %d)\n", futileCnt, lmpCnt, razorCnt, nullCnt, verifyCnt, zugCnt);
+  printf("# repetition scans: %d of %d skipped\n", repProbes - repScans, repProbes);
+  printf("# eval cache: %d hits of %d probes (%d%%), %d lazy\n", evalHits, evalProbes, evalProbes ? (int) (100LL*evalHits/evalProbes) : 0, lazyCnt);
+#else
+  printf("# compiled without STATS\n");
+#endif
+}
+
+void
+WriteTrace (char *name)
+{ // save search trace of last search for offline decoding by tracedump
+#ifdef TRACE
+  TraceHeader h = { TRACE_MAGIC, traceCnt < TRACE ? traceCnt : TRACE, bFiles, bRanks };
+  FILE *f = fopen(name, "wb");
+  int first = traceCnt < TRACE ? 0 : traceCnt & TRACE-1; // oldest record
+  if(!f) { printf("# cannot open %s\n", name); return; }
+  memcpy(h.toList, toList, sizeof(h.toList));
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(traceBuf + first, sizeof(TraceRecord), h.count - first, f); // wrapped buffer is written in two parts
+  fwrite(traceBuf, sizeof(TraceRecord), first, f);
+  fclose(f);
+  printf("# %d trace records written to %s\n", h.count, name);
+#else
+  printf("# compiled without TRACE\n");
+#endif
+}
+
+typedef struct { // node of the search tree, with the arguments and locals a recursive search would keep on the C stack
+  Color stm; int alpha, beta, difEval, depth, lmr; Move oldPromo, promoSuppress; int threshold, msp;
+  int i, j, k, king, defer, autoFail, late, ep, searched, pvs, aspDelta, razor, nQuiets, verify, nullDep, nullRed;
+  int firstMove, curMove, sorted, bestMoveNr, resDep, iterDep, ext, myPV, mobility, childMob;
+  int score, bestScore, oldBest, curEval, iterAlpha, phase, nextVictim;
+  Move move, nullMove, hashMove;
+  HashKey index, hit;
+  HashBucket *hashTab;
+  Flag inCheck;
+  char resume;           // where to continue when daughter node returns (0 = node not entered yet)
+  char caller;           // node was pushed by SearchStart, so its score must be returned to caller of SearchRun
   UndoInfo tb;
+  Move quiets[64];       // quiet moves searched in this iteration
+} Frame;
+
+#define FRAME_VARS(X) X(stm) X(alpha) X(beta) X(difEval) X(depth) X(lmr) X(oldPromo) X(promoSuppress) X(threshold) X(msp) \
+  X(i) X(j) X(k) X(king) X(defer) X(autoFail) X(late) X(ep) X(searched) X(pvs) X(aspDelta) X(razor) X(nQuiets) X(verify) \
+  X(nullDep) X(nullRed) X(firstMove) X(curMove) X(sorted) X(bestMoveNr) X(resDep) X(iterDep) X(ext) X(myPV) X(mobility) \
+  X(childMob) X(score) X(bestScore) X(oldBest) X(curEval) X(iterAlpha) X(phase) X(nextVictim) X(move) X(nullMove) \
+  X(hashMove) X(index) X(hit) X(hashTab) X(inCheck)
+#define SAVE_VAR(v) f->v = v;
+#define LOAD_VAR(v) v = f->v;
+
+THREAD Frame frames[LEVELS];
+THREAD int frameNr = -1; // top of frame stack
+THREAD int searchScore;  // score of node pushed by SearchStart, after SearchRun finished it
+
+static void
+PushNode (int caller, Color stm, int alpha, int beta, int difEval, int depth, int lmr, Move oldPromo, Move promoSuppress, int threshold, int msp)
+{ // put node on frame stack, to be entered by SearchRun
+  Frame *f = frames + ++frameNr;
+  f->resume = 0; f->caller = caller;
+  f->stm = stm; f->alpha = alpha; f->beta = beta; f->difEval = difEval; f->depth = depth; f->lmr = lmr;
+  f->oldPromo = oldPromo; f->promoSuppress = promoSuppress; f->threshold = threshold; f->msp = msp;
+}
+
+void
+SearchStart (Color stm, int alpha, int beta, int difEval, int depth, int lmr, Move oldPromo, Move promoSuppress, int threshold, int msp)
+{ // prepare search of the current position; SearchRun then does the work
+  PushNode(1, stm, alpha, beta, difEval, depth, lmr, oldPromo, promoSuppress, threshold, msp);
+}
+
+int
+SearchRun (int budget)
+{ // search the tree on the frame stack, until the node of SearchStart is done (1), or budget nodes are spent (0).
+  // In the latter case the top frame is a node not entered yet, and a next call resumes the search there.
+  // The tree walk is the recursive alpha-beta it always was: where a daughter has to be searched, the locals
+  // are saved in the frame, the daughter is pushed, and its score comes back in 'result' at the resume label.
+  int i, j, k, king, defer, autoFail, late, ep, searched, pvs, aspDelta, razor, nQuiets, verify, nullDep, nullRed;
+  Flag inCheck;
+  int firstMove, curMove, sorted, bestMoveNr;
+  int resDep, iterDep, ext;
+  int myPV, mobility, childMob; // mobility of this node, as mapped by parent, and of daughter
+  int score, bestScore, oldBest, curEval, iterAlpha, phase, nextVictim;
+  Move move, nullMove;
+  Color stm; int alpha, beta, difEval, depth, lmr; Move oldPromo, promoSuppress; int threshold, msp;
+  int result, start = nodes;
+  Frame *f;
 #ifdef HASH
   Move hashMove; HashKey index, hit;
+  HashBucket *hashTab;
 #endif
-/*if(PATH) pboard(board),pmap(BLACK);*/
+
+enter:
+  f = frames + frameNr;
+  if(nodes - start >= budget) return 0; // suspend before entering node
+  stm = f->stm; alpha = f->alpha; beta = f->beta; difEval = f->difEval; depth = f->depth; lmr = f->lmr;
+  oldPromo = f->oldPromo; promoSuppress = f->promoSuppress; threshold = f->threshold; msp = f->msp;
+  autoFail = razor = verify = aspDelta = inCheck = bestMoveNr = resDep = bestScore = 0; late = 100000;
+  i = ep = score = nullDep = nullRed = 0; // only to keep compiler quiet about saving them
+  myPV = pvPtr; mobility = mobilityScore; nullMove = ABSENT;
 #if 0
 printf("\n# search(%d) {%d,%d} eval=%d stm=%d ",level,alpha,beta,difEval,stm);
 #endif
@@ -480,17 +786,17 @@ printf("\n# search(%d) {%d,%d} eval=%d stm=%d ",level,alpha,beta,difEval,stm);
     k = p[king=royal[stm]].pos;
     if( k == ABSENT) {
       if((k = p[king + 2].pos) == ABSENT && (!tsume || tsume & stm+1))
-        return -INF;   // lose when no King (in tsume only for side to be mated)
+        { result = -INF; goto done; } // lose when no King (in tsume only for side to be mated)
     } else if(p[king + 2].pos != ABSENT) {
       if(tsume && tsume & stm+1) {
-        retDep = 60; return INF; // we win when not in check
+        retDep = 60; result = INF; goto done; // we win when not in check
       }
       k = ABSENT; // two kings is no king...
     }
     if( k != ABSENT) { // check is possible
-      inCheck = InCheck(stm, level);
+      inCheck = ATTACK(k, INVERT(stm)) != 0; // the parent already mapped the attacks in this node
       if(!inCheck && (tsume && tsume & stm+1)) {
-        retDep = 60; return INF; // we win when not in check
+        retDep = 60; result = INF; goto done; // we win when not in check
       }
     }
   }
@@ -502,43 +808,60 @@ printf("\n# search(%d) {%d,%d} eval=%d stm=%d ",level,alpha,beta,difEval,stm);
   k = p[king=royal[INVERT(stm)]].pos;
   if(k != ABSENT) {
     if(ATTACK(k, stm) && p[king + 2].pos == ABSENT) { // we have an attack on his only King
-      return INF;
+      result = INF; goto done;
     }
   } else { // he has no king! Test for attacks on Crown Prince
     k = p[king + 2].pos;
     if(k == ABSENT ? !tsume : ATTACK(k, stm)) { // we have attack on Crown Prince
-      return INF;
+      result = INF; goto done;
     }
   }
+  // ENDGAME TABLES
+  if(men <= TBMEN && *tbPath && level && !tsume) { // exact result, so no need to search (but root must find a move)
+    int code = TBProbe(stm);
+    if(code != TB_NONE) { retDep = 60; result = (code == TB_DRAW ? 0 : code & 1 ? -INF + code : INF + 1 - code); goto done; }
+  }
   // EVALUATION & WINDOW SHIFT
-  curEval = Evaluate(stm, tsume, difEval) -20*inCheck;
+  if(depth > QSDEPTH || inCheck) TIMED(T_EVAL, curEval = Evaluate(stm, tsume, difEval, -INF, INF) - 20*inCheck); // pruning decisions need exact eval
+  else TIMED(T_EVAL, curEval = Evaluate(stm, tsume, difEval, alpha, beta)); // QS: only stand pat matters, so lazy eval is OK
+  STAT(nodeCnt[depth > QSDEPTH]++;)
   alpha -= (alpha < curEval);
   beta  -= (beta <= curEval);
 
-  if(!(nodes++ & 4095)) abortFlag = TerminationCheck(stm);
+  nodes++;
   pv[pvPtr++] = 0; // start empty PV, directly behind PV of parent
   if(inCheck) lmr = 0; else depth -= lmr; // no LMR of checking moves
+#ifdef FUTILITY
+  if(depth == QSDEPTH + 3 && pruneScale && level && !inCheck && !tsume && beta - alpha == 1 && curEval + razorMargin <= alpha)
+    { depth--, razor = 1; STAT(razorCnt++;) } // limited razoring: hopeless pre-pre-frontier node searched 1 ply less
+#endif
 
-  firstMove = j = curMove = sorted = msp; // leave 50 empty slots in front of move list
-  iterDep = -(depth == 0); tb.fireMask = 0;
+  msp += 50; firstMove = j = curMove = sorted = msp; // leave 50 empty slots in front of move list, so prepending does not clobber parent
+  iterDep = -(depth == 0); f->tb.fireMask = 0;
 
 #if 0
   printf("depth=%d iterDep=%d resDep=%d\n", depth, iterDep, resDep);
 #endif
 #ifdef HASH
-  hashMove = LookupHashMove(stm, alpha, beta, &depth, &lmr, oldPromo, promoSuppress, &bestMoveNr, &bestScore, &iterDep, &resDep, &index, &hit);
+  hashTab = hashTable;
+  TIMED(T_HASH, hashMove = LookupHashMove(hashTable, hashMask, stm, alpha, beta, &depth, &lmr, oldPromo, promoSuppress, &bestMoveNr, &bestScore, &iterDep, &resDep, &index, &hit));
+  if(hit == 5) { // QS node that would have to evict full-width entry: resort to QS table
+    hashTab = qsTable;
+    TIMED(T_HASH, hashMove = LookupHashMove(qsTable, QSHASH-1, stm, alpha, beta, &depth, &lmr, oldPromo, promoSuppress, &bestMoveNr, &bestScore, &iterDep, &resDep, &index, &hit));
+  }
+  STAT(if(iterDep >= depth) hashCuts++;)
 #if 0
 printf("# iterDep = %d score = %d hash move = %s\n",iterDep,bestScore,MoveToText(hashMove,0));
 #endif
 #endif
 
   if(depth > QSDEPTH) iterDep = MAX(iterDep, QSDEPTH); // full-width: start at least from 1-ply
-  for(int phase = 0, nextVictim = INVERT(stm); ++iterDep <= depth; phase = 0, nextVictim = INVERT(stm)) {
+  for(phase = 0, nextVictim = INVERT(stm); ++iterDep <= depth; phase = 0, nextVictim = INVERT(stm)) {
 #if 0
 if(depth >= QSDEPTH) printf("# new iter %d:%d\n", depth, iterDep);
 #endif
     oldBest = bestScore;
-    iterAlpha = alpha; bestScore = -INF; bestMoveNr = 0; resDep = 60;
+    iterAlpha = alpha; bestScore = -INF; bestMoveNr = 0; resDep = 60; searched = nQuiets = 0;
     if(depth <= QSDEPTH) {
       bestScore = curEval; resDep = QSDEPTH;
       if(bestScore > alpha) {
@@ -546,33 +869,43 @@ if(depth >= QSDEPTH) printf("# new iter %d:%d\n", depth, iterDep);
 #if 0
 printf("# stand pat %d (beta=%d)\n", bestScore, beta);
 #endif
-        if(bestScore >= beta) goto cutoff;
+        if(bestScore >= beta) { STAT(standPatCuts++;) goto cutoff; }
       }
     }
     for(curMove = firstMove; ; curMove++) { // loop over moves
-if(PATH) printf("# phase=%2d: (%4d:%4d:%4d) depth=%d:%d (%d) 0x%05X\n", phase, firstMove, curMove, msp, iterDep, depth, resDep, moveStack[msp-1]);
       // MOVE SOURCE
       if(curMove >= msp) { // we ran out of moves; generate some new
         moveStack[curMove] = INVALID; // invalidate cache in case move generation fails
-if(PATH) printf("# new moves (%4d:%4d:%4d) phase=%d\n", firstMove, curMove, msp, phase);
         switch(phase) {
           case 0: // null move
 #ifdef NULLMOVE
-            if(depth > QSDEPTH && curEval >= beta && !inCheck && filling > 10) {
-              int nullDep = depth - 3;
+            if(depth > QSDEPTH && curEval >= beta && !inCheck && filling > 10 && !verify && level) {
+              nullRed = nullR + (depth - QSDEPTH)/6 + MIN((curEval - beta)/nullUnit, 2); // adaptive reduction
+              nullDep = depth - nullRed < QSDEPTH ? QSDEPTH : depth - nullRed;
               stm ^= WHITE;
+              repStack[level+LEVELS] = hashKeyH; // the position with the opponent to move is on the path, like after any move
+              repFilter[hashKeyH & REP_FILTER]++;
 variation[level++] = INVALID;
-if(PATH) printf("%d:%d null move\n", level, depth);
-              int score = -Search(stm, -beta, 1-beta, -difEval, nullDep<QSDEPTH ? QSDEPTH : nullDep, 0, promoSuppress & SQUARE, ABSENT, INF, msp);
-if(PATH) printf("%d:%d null move score = %d\n", level, depth, score);
+              memcpy(attacks, attacksByLevel[level-1], sizeof(attacks)); // same position, so same attacks
+              mobilityScore = mobility; promoDelta = -promoDelta;          // and same mobility; MakeMove would flip promoDelta
+              FRAME_VARS(SAVE_VAR) f->resume = 1;
+              PushNode(0, stm, -beta, 1-beta, -difEval, nullDep, 0, promoSuppress & SQUARE, ABSENT, INF, msp);
+              goto enter;
+            nullReturn:
+              score = -result;
+              TRACE_NODE(0, beta-1, beta, score, nullDep, 0, TR_NULL);
 level--;
-              stm ^= WHITE;
-              if(score >= beta) { retDep += 3; pvPtr = myPV; return score + (score < curEval); }
+              repFilter[hashKeyH & REP_FILTER]--;
+              stm ^= WHITE; promoDelta = -promoDelta;
+              if(score >= beta) {
+                if(verifyDepth && (depth - QSDEPTH >= verifyDepth || filling < 32) && abortFlag <= 0) { // deep or zugzwang-prone:
+                  verify = depth; depth = MAX(nullDep, iterDep); STAT(verifyCnt++;)                   // search to reduced depth without null move
+                } else { retDep += nullRed; pvPtr = myPV; STAT(nullCnt++;) result = score + (score < curEval); goto done; }
+              }
 //              else depth += lmr, lmr = 0;
             }
 #endif
-            if(tenFlag) FireSet(stm, &tb); // in tenjiku we must identify opposing Fire Demons to perform any moves
-if(PATH && tenFlag) printf("fireMask=%x\n",tb.fireMask),pbytes(fireBoard);
+            if(tenFlag) FireSet(stm, &f->tb); // in tenjiku we must identify opposing Fire Demons to perform any moves
             phase = 1;
           case 1: // hash move
             phase = 2;
@@ -587,31 +920,26 @@ if(PATH && tenFlag) printf("fireMask=%x\n",tb.fireMask),pbytes(fireBoard);
             nextVictim = INVERT(stm); autoFail = (depth == 0);
             phase = 3;
           case 3: // generate captures
-if(PATH) printf("%d:%2d:%2d (%4d:%4d:%4d) next victim\n",level,depth,iterDep,firstMove,curMove,msp);
             while(nextVictim < pieces[INVERT(stm)]) { // more victims may exist
               int group, to = p[nextVictim += 2].pos; // take next
               if(to == ABSENT || !ATTACK(to, stm)) continue; // skip if absent or not aligned
+              int gen = msp;                          // where the new captures start
               group = p[nextVictim].value;            // remember value of this found victim
               if(iterDep <= QSDEPTH + 1 && 2*group + curEval + 30 < alpha) {
                 resDep = QSDEPTH + 1; nextVictim -= 2;
                 if(bestScore < 2*group + curEval + 30) bestScore = 2*group + curEval + 30;
                 goto cutoff;
               }
-              msp = GenCapts(stm, to, 0, msp);
-if(PATH) printf("%d:%2d:%2d (%4d:%4d:%4d) group=%d to=%c%d\n",level,depth,iterDep,firstMove,curMove,msp,group,FILECH(to),RANK(to));
+              TIMED(T_CAPT, msp = GenCapts(stm, to, 0, msp));
               while(nextVictim < pieces[INVERT(stm)] && p[nextVictim+2].value == group) { // more victims of same value exist
                 to = p[nextVictim += 2].pos;   // take next
-if(PATH) printf("%d:%2d:%2d p=%d, to=%c%d\n", level, depth, iterDep, nextVictim, FILECH(to), RANK(to));
                 if(to == ABSENT || !ATTACK(to, stm)) continue; // skip if absent or not aligned
-                msp = GenCapts(stm, to, 0, msp);
-if(PATH) printf("%d:%2d:%2d last=%d 0x%05X\n",level,depth,iterDep,msp,moveStack[msp-1]);
+                TIMED(T_CAPT, msp = GenCapts(stm, to, 0, msp));
               }
-if(PATH) printf("%d:%2d:%2d (%4d:%4d:%4d) captures %d/%d generated 0x%05X (%d)\n", level, depth, iterDep, firstMove, curMove, msp, group, threshold, moveStack[curMove], sorted);
+              if(tsume && !(tsume & stm+1) && (msp = CheckFilter(stm, gen, msp)) == gen) continue; // tsume attacker must check
               goto extractMove; // in auto-fail phase, only search if they might auto-fail-hi
             }
-if(PATH) printf("# phase=%d autofail=%d\n", phase, autoFail);
             if(autoFail) { // non-captures cannot auto-fail; flush queued captures first
-if(PATH) printf("# phase=%d autofail end (%4d:%4d:%4d)\n", phase, firstMove, curMove, msp);
               autoFail = 0; curMove = firstMove - 1; continue; // release stashed moves for search (next phase)
             }
             phase = 4; // out of victims: all captures generated
@@ -630,30 +958,50 @@ if(PATH) printf("# phase=%d autofail end (%4d:%4d:%4d)\n", phase, firstMove, cur
 #endif
             phase = 5;
           case 5: // killers
-            if(depth <= QSDEPTH) { if(resDep > QSDEPTH) resDep = QSDEPTH; goto cutoff; }
+            if(depth <= QSDEPTH) {
+              if(qsChecks && depth == QSDEPTH && !inCheck && !tsume) { // non-capture checks in first QS ply
+                msp = GenChecks(stm, oldPromo, msp, 0);
+                phase = 9;
+                if(msp > curMove) break;
+              }
+              if(resDep > QSDEPTH) resDep = QSDEPTH;
+              goto cutoff;
+            }
             phase = 6;
           case 6: // non-captures
             nonCapts = msp;
-            msp = GenNonCapts(stm, oldPromo, msp, &nullMove);
+            if(tsume && !(tsume & stm+1)) msp = GenChecks(stm, oldPromo, msp, 0); // tsume attacker: non-checks would be refuted
+            else TIMED(T_NONCAPT, msp = GenNonCapts(stm, oldPromo, msp, &nullMove));
             if(msp == nonCapts) goto cutoff;
+            j = curMove;
+#ifdef HISTORY
+            { // put sort keys on non-captures
+              Move m = level > 0 ? variation[level-1] : INVALID, c = m ? counterMove[FROM(m)][m & SQUARE] : INVALID;
+              int l;
+              m = level > 1 ? variation[level-2] : INVALID; m = m ? followMove[FROM(m)][m & SQUARE] : INVALID;
+              for(l=j; l<msp; l++) moveStack[l] = QuietKey(moveStack[l], c, m);
+            }
+#endif
 #ifdef KILLERS
             { // swap killers to front
               Move m = killer[level][0];
               int l;
-              j = curMove;
-              for(l=j; l<msp; l++) if(moveStack[l] == m) { moveStack[l] = moveStack[j]; moveStack[j++] = m; break; }
+              for(l=j; l<msp; l++) if((moveStack[l] & MOVEMASK) == m) { m = moveStack[l]; moveStack[l] = moveStack[j]; moveStack[j++] = m; break; }
               m = killer[level][1];
-              for(l=j; l<msp; l++) if(moveStack[l] == m) { moveStack[l] = moveStack[j]; moveStack[j++] = m; break; }
+              for(l=j; l<msp; l++) if((moveStack[l] & MOVEMASK) == m) { m = moveStack[l]; moveStack[l] = moveStack[j]; moveStack[j++] = m; break; }
             }
 #endif
             late = j;
             phase = 7;
+#ifdef HISTORY
+            sorted = j - 1; // killers in front, rest by sort key
+#else
             sorted = msp; // do not sort noncapts
+#endif
             break;
           case 7: // bad captures
           case 8: // PV null move
             phase = 9;
-if(PATH) printf("# null = %0x\n", nullMove);
             if(nullMove != ABSENT) {
               moveStack[msp++] = nullMove + (nullMove << SQLEN) | DEFER; // kludge: setting DEFER guarantees != 0, and has no effect
               break;
@@ -672,31 +1020,41 @@ if(PATH) printf("# null = %0x\n", nullMove);
           if(move == INVALID || moveStack[i] > move) move = moveStack[j=i]; // search move with highest priority
         if(j>curMove) { moveStack[j] = moveStack[curMove]; moveStack[curMove] = move; } // swap highest-priority move to front of remaining
         if(move == INVALID) { msp = curMove--; continue; } // remaining moves are invalid; clip off move list
+#ifdef HISTORY
+        if(phase == 7 && curMove >= late + 12) sorted = msp; // only best few quiets are worth sorting
+#endif
       } else {
         move = moveStack[curMove];
         if(move == INVALID) continue; // skip invalidated move
       }
+      move &= MOVEMASK; // strip sort key
 #if 0
 if(depth >= 0) printf("# %2d (%d) extracted 0x%05X %2d. %-10s autofail=%d\n", phase, curMove, moveStack[curMove], level, MoveToText(moveStack[curMove], 0), autoFail);
 #endif
 
+      if(chuFlag && LionTrade(stm, move, promoSuppress)) { // Lion-trade rules, decided from the map of this node
+        if(!level) repeatMove[repCnt++] = move & REP_MASK | (LION(board[FROM(move)]) ? 3<<24 : 1<<24);
+        moveStack[curMove] = INVALID; // zap illegal lion moves
+        continue;
+      }
+
       // RECURSION
       stm ^= WHITE;
-      defer = MakeMove(stm, move, &tb);
+      TIMED(T_MAKE, defer = MakeMove(stm, move, &f->tb));
       ext = (depth == 0); // when out of depth we extend captures if there was no auto-fail-hi
 
-//      if(level == 1 && randomize) tb.booty += (hashKeyH * seed >> 24 & 31) - 20;
+//      if(level == 1 && randomize) f->tb.booty += (hashKeyH * seed >> 24 & 31) - 20;
 
       if(autoFail) {
-        UnMake(&tb); // never search moves during auto-fail phase
+        TIMED(T_UNMAKE, UnMake(&f->tb)); // never search moves during auto-fail phase
         stm ^= WHITE;
 #if 0
-printf("#       prune %d-%d ?= %d\n", tb.gain, tb.loss, threshold);
+printf("#       prune %d-%d ?= %d\n", f->tb.gain, f->tb.loss, threshold);
 #endif
-        if(tb.gain <= threshold) { // found refutations that cannot possibly auto-fail
+        if(f->tb.gain <= threshold) { // found refutations that cannot possibly auto-fail
           autoFail = 0; curMove = firstMove-1; continue; // release all for search (next phase)
         }
-        if(tb.gain - tb.loss > threshold) {
+        if(f->tb.gain - f->tb.loss > threshold) {
           bestScore = INF+1; resDep = 0; goto leave; // auto-fail-hi
         } else continue; // ignore for now if not obvious refutation
       }
@@ -704,7 +1062,9 @@ printf("#       prune %d-%d ?= %d\n", tb.gain, tb.loss, threshold);
 #if 0
 printf("#       validate 0x%04X %s\n", moveStack[curMove], MoveToText(moveStack[curMove], 0));
 #endif
-      for(i=2; i<=cnt50; i+=2) if(repStack[LEVELS+level-i] == hashKeyH) {
+      STAT(repProbes++;)
+      if(REP_SEEN(hashKeyH) STAT(&& ++repScans)) // only scan if position (probably) occurred before
+      for(i=2; i<=cnt50 && i<=LEVELS+level; i+=2) if(repStack[LEVELS+level-i] == hashKeyH) { // (game history is LEVELS deep)
 #if 0
 printf("#       repetition %d\n", i);
 #endif
@@ -725,47 +1085,60 @@ printf("#       repetition %d\n", i);
       }
       repStack[level+LEVELS] = hashKeyH;
 
-variation[level++] = move;
-mobilityScore = MapAttacks(level); // for as long as incremental update does not work.
-//if(PATH) pmap(stm);
-      if(chuFlag && (LION(tb.victim) || LION(tb.epVictim[0]))) {// verify legality of Lion capture in Chu Shogi
-#if 0
-printf("#       revalidate %d 0x%04X %s\n", level, moveStack[curMove], MoveToText(moveStack[curMove], 0));
-#endif
-        score = 0;
-        if(LION(tb.piece)) { // Ln x Ln: can make Ln 'vulnerable' (if distant and not through intemediate > GB)
-          if(dist(tb.from, tb.to) > 1 && ATTACK(tb.to, stm) && p[tb.epVictim[0]].value <= 50)
-            score = -INF;               // our defended Lion is invulnerable (cannot be captured)
-        } else {                        // other x Ln
-          if(promoSuppress & PROMOTE) { // non-Lion captures Lion after opponent did same
-            if(!okazaki || ATTACK(tb.to, stm)) score = -INF;
-          }
-          defer |= PROMOTE;                         // if we started, flag  he cannot do it in reply
+#ifdef FUTILITY
+      if(phase == 7 && iterDep <= QSDEPTH + 3 && pruneScale && level && !inCheck && !tsume && beta - alpha == 1
+                    && !(move & PROMOTE) && !InCheck(stm)) { // quiet non-checking move close to horizon
+        int d = iterDep - QSDEPTH;
+        if(searched && curMove - late > lmpCount[d]) { // late-move pruning
+          STAT(lmpCnt++;) TIMED(T_UNMAKE, UnMake(&f->tb)); stm ^= WHITE; continue;
         }
-        if(score == -INF) {
-          if(level == 1) repeatMove[repCnt++] = move & REP_MASK | (LION(tb.piece) ? 3<<24 : 1 << 24);
-          moveStack[curMove] = INVALID; // zap illegal lion moves
-          goto abortMove;
+        if(d < 3 && (score = curEval + f->tb.booty + futMargin[d]) <= iterAlpha) { // (extended) futility pruning
+          STAT(futileCnt++;) TIMED(T_UNMAKE, UnMake(&f->tb)); stm ^= WHITE;
+          if(score > bestScore) bestScore = score;
+          continue;
         }
       }
+#endif
+      if(phase == 7 && nQuiets < 64) f->quiets[nQuiets++] = move; // remember searched quiets for history malus
+      repFilter[hashKeyH & REP_FILTER]++;
+variation[level++] = move;
+TIMED(T_MAP, mobilityScore = childMob = MapAttacks(level)); // for as long as incremental update does not work.
+      if(chuFlag && !LION(f->tb.piece) && (LION(f->tb.victim) || LION(f->tb.epVictim[0])))
+        defer |= PROMOTE; // non-Lion x Ln: if we started, flag he cannot do it in reply
 #if 1 // HGM
-      score = -Search(stm, -beta, -iterAlpha, -difEval - tb.booty, iterDep-1+ext,
-                       curMove >= late && iterDep > QSDEPTH + lmr,
-                                                      promoSuppress & ~PROMOTE, defer, depth ? INF : tb.gain, msp);
+      if((pvs = searched++ && iterDep > QSDEPTH && beta - iterAlpha > 1)) { // PVS: later moves only have to prove they are worse
+        FRAME_VARS(SAVE_VAR) f->resume = 2;
+        PushNode(0, stm, -iterAlpha-1, -iterAlpha, -difEval - f->tb.booty, iterDep-1+ext,
+                         curMove >= late && iterDep > QSDEPTH + lmr,
+                                                        promoSuppress & ~PROMOTE, defer, depth ? INF : f->tb.gain, msp);
+        goto enter;
+      pvsReturn:
+        score = -result;
+      }
+      if(!pvs || score > iterAlpha && score < beta && abortFlag <= 0) { // first move, or fail high: (re-)search with open window
+        mobilityScore = childMob, pvs *= 2; // null-window search clobbered it
+        FRAME_VARS(SAVE_VAR) f->resume = 3;
+        PushNode(0, stm, -beta, -iterAlpha, -difEval - f->tb.booty, iterDep-1+ext,
+                         !pvs && curMove >= late && iterDep > QSDEPTH + lmr,
+                                                        promoSuppress & ~PROMOTE, defer, depth ? INF : f->tb.gain, msp);
+        goto enter;
+      openReturn:
+        score = -result;
+      }
 #else
       score = 0;
 #endif
-    abortMove:
+      TRACE_NODE(move, iterAlpha, pvs == 1 ? iterAlpha + 1 : beta, score, iterDep-1+ext, phase, pvs == 1 ? TR_PVS : 0);
 level--;
+      repFilter[hashKeyH & REP_FILTER]--;
     repetition:
-      UnMake(&tb);
+      TIMED(T_UNMAKE, UnMake(&f->tb));
       stm ^= WHITE;
       if(abortFlag > 0) { // unwind search
 printf("# abort (%d) @ %d\n", abortFlag, level);
         if(curMove == firstMove) bestScore = oldBest, bestMoveNr = firstMove; // none searched yet
         goto leave;
       }
-if(PATH) printf("%d:%2d:%2d %d 0x%05X %s %d %d (%d)\n", level, depth, iterDep, curMove, moveStack[curMove], MoveToText(moveStack[curMove], 0), score, bestScore, GetTickCount());
 
       // ALPHA-BETA STUFF
       if(score > bestScore) {
@@ -783,69 +1156,111 @@ if(PATH) printf("%d:%2d:%2d %d 0x%05X %s %d %d (%d)\n", level, depth, iterDep, c
             moveStack[curMove] = 0;
           }
           bestMoveNr = firstMove;
+          { int i=pvPtr;
+            for(pvPtr = myPV+1; pv[pvPtr++] = pv[i++]; ); // copy daughter PV
+            pv[myPV] = move;                              // behind our move (pvPtr left at end of copy)
+          }
           if(score >= beta) { // beta cutoff
 #ifdef KILLERS
             if(iterDep == depth && move != killer[level][0]
-                 && (tb.victim == EMPTY && (move & SQUARE) < SPECIAL)) {
+                 && (f->tb.victim == EMPTY && (move & SQUARE) < SPECIAL)) {
               // update killer
               killer[level][1] = killer[level][0]; killer[level][0] = move;
             }
+#endif
+#ifdef HISTORY
+            if(f->tb.victim == EMPTY && (move & SQUARE) < SPECIAL && !(move & PROMOTE) && iterDep > QSDEPTH) {
+              int d = iterDep - QSDEPTH, bonus = d*d*8 > HISTORY/2 ? HISTORY/2 : d*d*8;
+              Move m;
+              UpdateHistory(move, bonus);
+              for(i=0; i<nQuiets; i++) if(f->quiets[i] != move && (f->quiets[i] & SQUARE) < SPECIAL) UpdateHistory(f->quiets[i], -bonus);
+              if(level > 0 && (m = variation[level-1])) counterMove[FROM(m)][m & SQUARE] = move;
+              if(level > 1 && (m = variation[level-2])) followMove[FROM(m)][m & SQUARE] = move;
+            }
 #endif
             resDep = retDep+1-ext;
+            STAT(phaseCuts[phase]++; firstCuts += (searched == 1);)
             goto cutoff;
           }
-          { int i=pvPtr;
-            for(pvPtr = myPV+1; pv[pvPtr++] = pv[i++]; ); // copy daughter PV
-            pv[myPV] = move;                              // behind our move (pvPtr left at end of copy)
-          }
         }
       }
       if(retDep+1-ext < resDep) resDep = retDep+1-ext;
     } // next move
   cutoff:
     if(!level) { // root node
-      lastRootIter = GetTickCount() - startTime;
+      lastRootIter = GetTickCount() - startTime; rootDepth = iterDep - QSDEPTH;
+      TRACE_NODE(pv[0], alpha, beta, bestScore, iterDep, phase, TR_ROOT);
+      if(*testMoves[0] || *testMoves[1]) CheckSolution();
       if(postThinking > 0) {
         int i;   // WB thinking output
         printf("%d %d %d %d", iterDep-QSDEPTH, bestScore, lastRootIter/10, nodes);
         if(ponderMove) printf(" (%s)", MoveToText(ponderMove, 0));
         for(i=0; pv[i]; i++) printf(" %s", MoveToText(pv[i], 0));
+        if(bestScore <= alpha) printf("?"); else if(bestScore >= beta) printf("!"); // aspiration fail low / high
         if(iterDep == QSDEPTH+1) printf(" { root eval = %4.2f dif = %4.2f; abs = %4.2f f=%d D=%4.2f %d/%d}", curEval/100., difEval/100., PSTest()/100., filling, promoDelta/100., Ftest(0), Ftest(1));
         printf("\n");
       }
+#ifdef ASPIRATION
+      if(bestScore <= alpha || bestScore >= beta) { // aspiration failure: widen window on failing side, and redo iteration
+        aspDelta *= 2;
+        if(bestScore <= alpha) {
+          alpha = aspDelta > 16*ASPIRATION ? -INF-1 : bestScore - aspDelta;
+          if(tlim1 < tlim2) tlim1 += tlim2 - tlim1 >> 1; // score drop: grant extra time to resolve it
+        } else beta = aspDelta > 16*ASPIRATION ? INF+1 : bestScore + aspDelta;
+        iterDep--; continue;
+      }
+#endif
       if((abortFlag == 0 || abortFlag == 2) && GetTickCount() - startTime > tlim1) break; // do not start iteration we can (most likely) not finish
+      if(abortFlag < 0 && ponderDepth && iterDep - QSDEPTH >= ponderDepth) break; // end of round in pondering on several replies
+#ifdef ASPIRATION
+      aspDelta = ASPIRATION; // next iteration starts with narrow window around this score, unless mate score
+      alpha = bestScore > -INF+1000 && bestScore < INF-1000 ? bestScore - aspDelta : -INF-1;
+      beta  = bestScore > -INF+1000 && bestScore < INF-1000 ? bestScore + aspDelta :  INF+1;
+#endif
     }
 #if 0
     printf("# (%d) %d CUT %d %d %d MAX(%d) %d\n", curMove, phase, depth, iterDep, resDep, MAX(iterDep, resDep), level);
 #endif
     iterDep = MAX(iterDep, resDep); // skip iterations if we got them for free
 #ifdef LMR
-    if(lmr && bestScore <= alpha && iterDep == depth)
+    if(lmr && bestScore <= alpha && bestScore < beta && iterDep == depth) // (stand pat can have raised alpha to beta)
       depth++, lmr--; // self-deepen on fail-low reply to late move by lowering reduction
 #endif
     if(stalemate && bestScore == -INF && !inCheck) bestScore = 0; // stalemate
 #ifdef HASH
     // hash store
-    hashTable[index].lock[hit]  = hashKeyH;
-    hashTable[index].depth[hit] = resDep;
-    hashTable[index].score[hit] = bestScore;
-    hashTable[index].flag[hit]  = (bestScore < beta) * H_UPPER;
+    if(hashTab[index].lock[hit] != hashKeyH) hashTab[index].move[hit] = 0; // fail low keeps move of earlier search
+    hashTab[index].lock[hit]  = hashKeyH;
+    hashTab[index].depth[hit] = resDep;
+    hashTab[index].score[hit] = bestScore;
+    hashTab[index].flag[hit]  = (bestScore < beta) * H_UPPER;
     if(bestScore > alpha) {
-      hashTable[index].flag[hit] |= H_LOWER;
-      hashTable[index].move[hit]  = bestMoveNr ? moveStack[bestMoveNr] : 0;
-    } else hashTable[index].move[hit] = 0;
+      hashTab[index].flag[hit] |= H_LOWER;
+      hashTab[index].move[hit]  = bestMoveNr ? moveStack[bestMoveNr] & MOVEMASK : 0;
+    }
+#endif
+#ifdef NULLMOVE
+    if(verify > depth && bestScore < beta && iterDep >= depth)
+      { depth = verify; STAT(zugCnt++;) } // null-move cutoff not confirmed (zugzwang?): search to full depth after all
 #endif
   } // next depth
 leave:
-  retFirst = firstMove;
-  retMSP = msp;
   pvPtr = myPV; // pop PV
-  retMove = bestMoveNr ? moveStack[bestMoveNr] : INVALID;
-  retDep = resDep - (inCheck & depth >= QSDEPTH) + lmr;
+  retMove = bestMoveNr ? moveStack[bestMoveNr] & MOVEMASK : INVALID;
+  retDep = resDep - (inCheck & depth >= QSDEPTH) + lmr + razor + (verify > depth ? verify - depth : 0);
 #if 0
 printf("#       %d %s (t=%d s=%d lim=%d)\n", bestScore, MoveToText(retMove, 0), GetTickCount(), startTime, tlim1);
 #endif
-  return bestScore + (bestScore < curEval);
+  result = bestScore + (bestScore < curEval);
+done: // node is finished with score 'result': return it to parent
+  if(frames[frameNr--].caller) { searchScore = result; return 1; }
+  f = frames + frameNr;
+  FRAME_VARS(LOAD_VAR)
+  switch(f->resume) {
+    case 1: goto nullReturn;
+    case 2: goto pvsReturn;
+    default: goto openReturn;
+  }
 }
 
 void
@@ -871,18 +1286,14 @@ pmoves(int start, int end)
     #define NONE    3
     #define ANALYZE 4
 
-    // some parameter of your engine
-    #define MAXMOVES 2000 /* maximum game length  */
-    #define MAXPLY   60   /* maximum search depth */
-
     #define OFF 0
     #define ON  1
 
-    int moveNr;              // part of game state; incremented by MakeMove
-    Move gameMove[MAXMOVES]; // holds the game history
+    THREAD int moveNr;              // part of game state; incremented by MakeMove
+    THREAD Move gameMove[MAXMOVES]; // holds the game history
 
-UndoInfo undoInfo;
-int lastLift, lastPut;
+THREAD UndoInfo undoInfo;
+THREAD int lastLift, lastPut;
 
 Color
 MakeMove2 (Color stm, Move move)
@@ -892,11 +1303,12 @@ MakeMove2 (Color stm, Move move)
   sup0 = sup1;
   sup1 = sup2;
   sup2 = MakeMove(stm, move, &undoInfo);
-  if(chuFlag && LION(undoInfo.victim) && LION(undoInfo.piece)) sup2 |= PROMOTE; // flag Lion x Lion
+  if(chuFlag && !LION(undoInfo.piece) && (LION(undoInfo.victim) || LION(undoInfo.epVictim[0])))
+    sup2 |= PROMOTE; // flag non-Lion x Lion, as Search does, so the counterstrike rule also works in the root
   rootEval = -rootEval - undoInfo.booty;
   for(i=0; i<LEVELS; i++)
     repStack[i] = repStack[i+1], checkStack[i] = checkStack[i+1];
-  repStack[LEVELS-1] = hashKeyH, checkStack[LEVELS-1] = InCheck(stm, level);
+  repStack[LEVELS-1] = hashKeyH, checkStack[LEVELS-1] = InCheck(INVERT(stm)); // side that now has the move
 #if 0
   printf("# made move %s %c%d %c%d\n", MoveToText(move, 0), FILECH(sup1), RANK(sup1), FILECH(sup2), RANK(sup2));
 #endif
@@ -904,16 +1316,12 @@ MakeMove2 (Color stm, Move move)
 }
 
 Flag
-InCheck (Color stm, int level)
-{
+InCheck (Color stm)
+{ // scan for attacks on the royal, so that no attack map has to be (re)built for it
   int k = p[royal[stm]].pos;
   if( k == ABSENT) k = p[royal[stm] + 2].pos;
   else if(p[royal[stm] + 2].pos != ABSENT) k = ABSENT; // two kings is no king...
-  if( k != ABSENT) {
-    MapAttacks(level);
-    if(ATTACK(k, INVERT(stm))) return 1;
-  }
-  return 0;
+  return k != ABSENT && SquareAttacked(k, INVERT(stm));
 }
 
 void
@@ -931,18 +1339,24 @@ UnMake2 (Move move)
 Color
 SetUp2 (char *fen)
 {
-  char *p;
+  int i;
+  char *s;
   Color stm = WHITE;
+  memset(evalCache, 0, sizeof(evalCache)); // new game: forget cached evaluations
   if(fen) {
     char *q = strchr(fen, '\n');
     if(q) *q = '\0';
     if(q = strchr(fen, ' ')) stm = (q[1] == 'b' ? BLACK : WHITE), q[0] = '\0'; // fen contains color field
   } else fen = variant->array;
-  rootEval = promoDelta = filling = cnt50 = moveNr = 0;
+  rootEval = promoDelta = filling = men = cnt50 = moveNr = 0;
   SetUp(fen, variant->IDs, currentVariant);
   sup0 = sup1 = sup2 = ABSENT;
   hashKeyH = hashKeyL = 87620895*currentVariant + !!fen;
-  for(p=startPos; *p++ = *fen++; ) {} // remember last start position for undo
+  for(i=2; i<=pieces[WHITE] || i<=pieces[BLACK]; i++) if(p[i].pos != ABSENT) { // so that setups of different positions differ
+    hashKeyL ^= p[i].pieceKey * squareKey[p[i].pos];
+    hashKeyH ^= p[i].pieceKey * squareKey[p[i].pos + STEP(1, 0)];
+  }
+  for(s=startPos; *s++ = *fen++; ) {} // remember last start position for undo
   return stm;
 }
 
@@ -950,41 +1364,96 @@ void
 SetMemorySize (int n)
 {
 #ifdef HASH
-  static HashBucket *realHash;
-  static intptr_t oldSize;
+  static THREAD HashBucket *realHash;
+  static THREAD intptr_t oldSize;
   intptr_t l, m = 1;
   while(m*sizeof(HashBucket) <= n*512UL) m <<= 1; // take largest power-of-2 that fits
   if(m != oldSize) {
     if(oldSize) free(realHash);
     hashMask = m*1024 - 1; oldSize = m;
     realHash = malloc(m*1024*sizeof(HashBucket) + 64);
-    l = (intptr_t) realHash; hashTable = (HashBucket*) (l & ~63UL); // align with cache line
+    l = (intptr_t) realHash; hashTable = (HashBucket*) (l + 63 & ~63UL); // align with cache line
+  }
+  if(!qsTable) { // fixed size, so it stays in L2 cache
+    l = (intptr_t) calloc(QSHASH*sizeof(HashBucket) + 64, 1); qsTable = (HashBucket*) (l + 63 & ~63UL);
   }
 #endif
 }
 
 int
-ListMoves (Color stm, int listStart, int listEnd)
-{ // create move list on move stack
-#if 0
-pboard(board);
-#endif
-  int i;
+GenRootMoves (Color stm, Move oldPromo, Move promoSuppress, int msp)
+{ // generate the legal moves in the root, applying the rules Search would otherwise only apply by searching them
+  int i, j, first = msp, ep, n, illegal;
+  Move move, nullMove;
+  UndoInfo tb;
   MapAttacks(level);
-  postThinking--; repCnt = 0; tlim1 = tlim2 = tlim3 = 1e8; abortFlag = listEnd = 0;
-  Search(stm, -INF-1, INF+1, 0, QSDEPTH+1, 0, sup1 & ~PROMOTE, sup2, INF, listEnd);
-  postThinking++;
+  for(i=INVERT(stm)+2; i<=pieces[INVERT(stm)]; i+=2) { // captures, for all victims
+    int to = p[i].pos;
+    if(to == ABSENT || !ATTACK(to, stm)) continue;
+    msp = GenCapts(stm, to, 0, msp);
+  }
+  if(chessFlag && (ep = promoSuppress & SQUARE) != ABSENT) { // e.p. captures, as Lion moves
+    n = board[ep + STEP(0, -1)];
+    if( n != EMPTY && (n&TYPE) == stm && PAWN(n) ) msp = NewCapture(ep + STEP(0, -1), SPECIAL + RAY(2, stm==WHITE ? 0 : RAYS/2), 0, msp);
+    n = board[ep + STEP(0, 1)];
+    if( n != EMPTY && (n&TYPE) == stm && PAWN(n) ) msp = NewCapture(ep + STEP(0, 1), SPECIAL + RAY(6, stm==WHITE ? 0 : RAYS/2), 0, msp);
+  }
+  nonCapts = msp;
+  msp = GenNonCapts(stm, oldPromo, msp, &nullMove);
+  if(nullMove != ABSENT) moveStack[msp++] = nullMove + (nullMove << SQLEN) | DEFER; // Lion pass
+
+  tb.fireMask = 0;
+  if(tenFlag) FireSet(stm, &tb);
+  for(i=n=first; i<msp; i++) { // filter out forbidden repetitions and illegal Lion captures
+    move = moveStack[i];
+    if(chuFlag && LionTrade(stm, move, promoSuppress)) { // Lion-trade rules
+      repeatMove[repCnt++] = move & REP_MASK | (LION(board[FROM(move)]) ? 3<<24 : 1<<24);
+      continue;
+    }
+    illegal = 0;
+    MakeMove(INVERT(stm), move, &tb);
+    if(!repDraws && !allowRep) for(j=2; j<=cnt50 && j<=LEVELS; j+=2) if(repStack[LEVELS+level-j] == hashKeyH) {
+      repeatMove[repCnt++] = move & REP_MASK; // remember why it was outlawed
+      illegal = 1; break;
+    }
+    UnMake(&tb);
+    if(!illegal) moveStack[n++] = move;
+  }
+  return n;
+}
 
-#if 0
-printf("last=%d nc=%d retMSP=%d\n", listEnd, nonCapts, retMSP);
-#endif
-  listEnd = retMSP;
+int
+ListMoves (Color stm, int listStart, int listEnd)
+{ // create list of legal moves on move stack (listEnd is ignored), from cache if we have it for this position
+  static THREAD HashKey keyH, keyL, history;
+  static THREAD int key[8], cacheLen = -1, cacheReps;
+  static THREAD Move cache[2000], cacheRep[LEVELS+(FIFTY*COLORS)];
+  int i, k[8] = { stm, sup1, sup2, cnt50, currentVariant, allowRep, okazaki, entryProm };
+  HashKey h = 0;
+  for(i=2; i<=cnt50 && i<=LEVELS; i+=2) h = h*1234567 ^ repStack[LEVELS+level-i]; // repetitions make it path dependent
+
+  if(cacheLen >= 0 && keyH == hashKeyH && keyL == hashKeyL && history == h && !memcmp(key, k, sizeof(k))) {
+    memcpy(moveStack + listStart, cache, cacheLen*sizeof(Move));
+    memcpy(repeatMove, cacheRep, cacheReps*sizeof(Move)); repCnt = cacheReps;
+    return listStart + cacheLen;
+  }
+
+  repCnt = 0;
+  listEnd = GenRootMoves(stm, sup1 & ~PROMOTE, sup2, listStart);
   if(currentVariant == V_LION) listEnd = GenCastlings(stm, listEnd); // castlings for Lion Chess
   if(currentVariant == V_WOLF) for(i=listStart; i<listEnd; i++) { // mark Werewolf captures as promotions
     int to = moveStack[i] & SQUARE, from = FROM(moveStack[i]);
     if(to >= SPECIAL) continue;
     if(p[board[to]].ranking >= 5 && p[board[from]].ranking < 4) moveStack[i] |= PROMOTE;
   }
+
+  cacheLen = -1;
+  if(listEnd - listStart <= sizeof(cache)/sizeof(Move)) { // remember for next time (e.g. repeated lift commands)
+    keyH = hashKeyH; keyL = hashKeyL; history = h; memcpy(key, k, sizeof(k));
+    cacheLen = listEnd - listStart; cacheReps = repCnt;
+    memcpy(cache, moveStack + listStart, cacheLen*sizeof(Move));
+    memcpy(cacheRep, repeatMove, repCnt*sizeof(Move));
+  }
   return listEnd;
 }
 
@@ -1053,9 +1522,50 @@ Highlight (int listStart, int listEnd, char *coords)
   printf("highlight %s\n", buf);
 }
 
-int timeLeft;                            // timeleft on engine's clock
-int mps, timeControl, inc, timePerMove;  // time-control parameters, to be used by Search
-char inBuf[8000], command[80], ponderMoveText[20];
+THREAD int timeLeft;                            // timeleft on engine's clock
+THREAD int mps, timeControl, inc, timePerMove;  // time-control parameters, to be used by Search
+THREAD char inBuf[8000], command[80], ponderMoveText[20];
+
+int
+ParseOption (char *s)
+{ // setting of engine-defined option; find out which
+  char buf[80];
+  if(sscanf(s, "Full analysis PV=%d", &noCut)  == 1) return 1;
+  if(sscanf(s, "Allow repeats=%d", &allowRep)  == 1) return 1;
+  if(sscanf(s, "Resign=%d",   &resign)         == 1) return 1;
+  if(sscanf(s, "Contempt=%d", &contemptFactor) == 1) return 1;
+  if(sscanf(s, "Okazaki rule=%d", &okazaki)    == 1) return 1;
+  if(sscanf(s, "QS checks=%d", &qsChecks)      == 1) return 1;
+  if(sscanf(s, "Pruning margin=%d", &pruneScale) == 1) return 1;
+  if(sscanf(s, "Null-move reduction=%d", &nullR) == 1) return 1;
+  if(sscanf(s, "Null-move verification depth=%d", &verifyDepth) == 1) return 1;
+  if(sscanf(s, "Promote on entry=%d", &entryProm) == 1) return 1;
+  if(sscanf(s, "Ponder replies=%d", &ponderReplies) == 1) { ponderReplies = MAX(1, MIN(ponderReplies, MAXREPLIES)); return 1; }
+  if(sscanf(s, "MCTS workers=%d", &mctsWorkers) == 1) return 1;
+  if(sscanf(s, "MCTS tree MB=%d", &mctsMB) == 1) { mctsMB = MAX(1, mctsMB); return 1; }
+  if(sscanf(s, "MCTS playout plies=%d", &mctsPlies) == 1) { mctsPlies = MAX(0, MIN(mctsPlies, 20)); return 1; }
+  if(!strncmp(s, "MCTS variants=", 14)) { // list can be empty
+    int n = strcspn(s + 14, "\r\n");
+    snprintf(mctsVariants, sizeof(mctsVariants), "%.*s", n, s + 14);
+    return 1;
+  }
+  if(sscanf(s, "Tsume=%79s", buf) == 1) {
+    if(!strcmp(buf, "no"))    tsume = 0; else
+    if(!strcmp(buf, "Sente")) tsume = 1; else
+    if(!strcmp(buf, "Gote"))  tsume = 2;
+    return 1;
+  }
+  return 0;
+}
+
+void
+Options (int *v, int set)
+{ // copy values of the engine-defined options to (set = 0) or from (set = 1) v[NOPTS]
+  int *var[NOPTS] = { &noCut, &allowRep, &resign, &contemptFactor, &okazaki, &qsChecks, &pruneScale, &nullR, &verifyDepth, &entryProm, &tsume, &ponderReplies,
+                      &mctsWorkers, &mctsMB, &mctsPlies };
+  int i;
+  for(i=0; i<NOPTS; i++) if(set) *var[i] = v[i]; else v[i] = *var[i];
+}
 
 void
 SetSearchTimes (int timeLeft)
@@ -1074,22 +1584,78 @@ printf("# limits %d, %d, %d mode = %d\n", tlim1, tlim2, tlim3, abortFlag);
 int
 SearchBestMove (Color stm, Move *move, Move *ponderMove, int retMSP)
 {
-  int score;
+  int i, score;
 printf("# SearchBestMove\n");
   startTime = GetTickCount();
-  nodes = 0;
+  nodes = tbHits = 0;
+#ifdef STATS
+  futileCnt = lmpCnt = razorCnt = nullCnt = verifyCnt = zugCnt = repProbes = repScans = evalProbes = evalHits = lazyCnt = 0;
+  memset(timerTicks, 0, sizeof(timerTicks)); memset(timerCalls, 0, sizeof(timerCalls)); memset(phaseCuts, 0, sizeof(phaseCuts));
+  hashHits = hashMisses = hashCuts = firstCuts = standPatCuts = nodeCnt[0] = nodeCnt[1] = 0;
+  searchTicks = TICKS();
+#endif
+#ifdef TRACE
+  traceCnt = 0;
+#endif
+  memset(repFilter, 0, sizeof(repFilter)); // enter game history in repetition filter, back to the position after the last irreversible move
+  for(i=1; i<=cnt50+1 && i<=LEVELS; i++) repFilter[repStack[LEVELS-i] & REP_FILTER]++;
+  SetMargins();
+#ifdef HISTORY
+  if(!ponderDepth) { int i, j; for(i=0; i<NPIECES; i++) for(j=0; j<1<<SQLEN; j++) history[i][j] /= 2; } // age history of previous search
+#endif
 //printf("# s=%d\n", startTime);fflush(stdout);
-  MapAttacks(level);
+  mobilityScore = MapAttacks(level);
   retMove = INVALID; repCnt = 0;
-  score = Search(stm, -INF-1, INF+1, rootEval, maxDepth + QSDEPTH, 0, sup1, sup2, INF, retMSP);
+  if(MctsWanted()) { // variant too large for alpha-beta
+    score = MctsSearch(stm, retMSP);
+    if(*testMoves[0] || *testMoves[1]) CheckSolution();
+  } else {
+    SearchStart(stm, -INF-1, INF+1, rootEval, maxDepth + QSDEPTH, 0, sup1, sup2, INF, retMSP); // Search leaves its own gap behind root list
+    while(!SearchRun(4096)) abortFlag = TerminationCheck(stm); // look at clock and input between slices of the search
+    score = searchScore;
+  }
   *move = retMove;
   *ponderMove = pv[1];
+  STAT(searchTicks = TICKS() - searchTicks;)
 printf("# best=%s", MoveToText(pv[0],0));
 if(pv[1]) printf(" ponder=%s", MoveToText(pv[1],0));
 printf("\n");
   return score;
 }
 
+int
+Quiesce (Color stm, int msp)
+{ // score of current position for stm by quiescence search; it is searched as a node of level 1, so it gets no root treatment
+  level++;
+  mobilityScore = MapAttacks(level);
+  SearchStart(stm, -INF-1, INF+1, rootEval, QSDEPTH, 0, sup1, sup2, INF, msp);
+  while(!SearchRun(1<<30)) {}
+  level--;
+  return searchScore;
+}
+
+int
+RankReplies (Color stm, Move *reply, int n)
+{ // put the (at most) n replies the last search expected most in reply[], ponder move first; returns how many
+  int i, j, m = 0, score[MAXREPLIES];
+  if(ponderMove) reply[m] = ponderMove, score[m++] = -INF-1;
+  for(i=retFirst; i<retMSP && n > 1; i++) if(moveStack[i] != INVALID && moveStack[i] != ponderMove) {
+    HashKey index, nr;
+    int s = 5*INF; // replies the search did not reach come last
+    MakeMove2(stm, moveStack[i]);
+    index = HashIndex(INVERT(stm), sup1 & ~PROMOTE, sup2, hashMask); nr = (hashKeyL >> 30) & 3; // as Search of that node did
+    if(hashTable[index].lock[nr] != hashKeyH) nr = 4;
+    if(hashTable[index].lock[nr] == hashKeyH) { // score from our point of view; fail lows for us were good replies
+      s = hashTable[index].score[nr] + (hashTable[index].flag[nr] & H_UPPER ? 0 : 2*INF); // others were refuted
+    }
+    UnMake2(moveStack[i]);
+    if(m == n && s >= score[n-1]) continue;
+    for(j = (m < n ? m++ : n-1); j > 0 && score[j-1] > s; j--) reply[j] = reply[j-1], score[j] = score[j-1];
+    reply[j] = moveStack[i]; score[j] = s;
+  }
+  return m;
+}
+
     Color TakeBack (int n)
     { // reset the game and then replay it to the desired point
       int last;
@@ -1101,6 +1667,18 @@ printf("# setup done");fflush(stdout);
       return stm;
     }
 
+    int KingCapture(Color stm)
+    { // square of the opponent royal stm can capture, or ABSENT
+      int king, k = p[king=royal[INVERT(stm)]].pos;
+      if( k != ABSENT) { // test if King capture possible
+        if(SquareAttacked(k, stm) && p[king + 2].pos == ABSENT) return k; // we have an attack on his only King
+      } else { // he has no king! Test for attacks on Crown Prince
+        k = p[king + 2].pos;
+        if(k != ABSENT && SquareAttacked(k, stm)) return k; // we have attack on Crown Prince
+      }
+      return ABSENT;
+    }
+
     void PrintResult(Color stm, int score)
     {
       char tail[100];
@@ -1130,7 +1708,10 @@ printf("# in (mode = %d,%d): %s\n", root, abortFlag, command);
         if(!strcmp(command, "put"))     { ReadSquare(inBuf+4, &lastPut); continue; }  // ditto
         if(!strcmp(command, "."))       { inBuf[0] = 0; return; } // ignore for now
         if(!strcmp(command, "hover"))   { inBuf[0] = 0; return; } // ignore for now
-        if(!strcmp(command, "lift"))    { inBuf[0] = 0; retMSP = ListMoves(stm, retFirst, retMSP); Highlight(retFirst, retMSP, inBuf+5); return; } // treat here
+        if(!strcmp(command, "lift"))    { // treat here; while searching the root list is already there
+          inBuf[0] = 0; if(root || !retMSP) retMSP = ListMoves(stm, retFirst, retMSP);
+          Highlight(retFirst, retMSP, inBuf+5); return;
+        }
         if(!root && !strcmp(command, "usermove")) {
 printf("# move = %s#ponder = %s", inBuf+9, ponderMoveText);
           abortFlag = !!strcmp(inBuf+9, ponderMoveText);
@@ -1138,7 +1719,7 @@ printf("# move = %s#ponder = %s", inBuf+9, ponderMoveText);
 printf("# ponder hit\n");
             SetSearchTimes(10*timeLeft + GetTickCount() - startTime); // add time we already have been pondering to total
             if(lastRootIter > tlim1) abortFlag = 2; // abort instantly if we are in iteration we should not have started
-            inBuf[0] = 0; ponderMove = INVALID;
+            inBuf[0] = 0; ponderMove = INVALID; ponderHitTime = GetTickCount();
             return;
           }
         }
@@ -1154,10 +1735,343 @@ printf("# ponder hit\n");
         if(InputWaiting()) GetLine(stm, 0); // read & examine input command
       } else {            // check for time
         if(GetTickCount() - startTime > tlim3) abortFlag = 2;
+        if(nodeLimit && nodes >= nodeLimit) abortFlag = 2; // fixed-nodes search (self-play)
       }
       return abortFlag;
     }
 
+    void PonderResult(Move *reply, int *spent, int n, int cur, int start)
+    { // count ponder hit or miss after the opponent moved during search of reply[cur] (started at start)
+      char buf[20];
+      int i;
+      if(abortFlag == 1) ponderMove = reply[0]; // search clobbered it; pondering resumes after other input
+      if(abortFlag != 1) i = cur, spent[cur] += ponderHitTime - start; // hit on searched reply: search went on
+      else if(strcmp(command, "usermove")) return; // not interrupted by a move
+      else for(i=0; i<n; i++) { // other reply: its work is in hash
+        sprintf(buf, "%s\n", MoveToText(reply[i], 0));
+        if(!strcmp(inBuf+9, buf)) break;
+      }
+      ponderCnt++;
+      if(i < n) ponderHits++, ponderSaved += spent[i];
+if(i < n) printf("# ponder hit on reply %d of %d", i+1, n); else printf("# ponder miss");
+printf(": %d hits of %d moves, %d ms saved\n", ponderHits, ponderCnt, ponderSaved);
+    }
+
+    Color Ponder(Color stm, Move *move, int *score)
+    { // ponder on the likeliest replies until the opponent moves; the one last searched is left on the board
+      Move reply[MAXREPLIES];
+      int spent[MAXREPLIES], i, t, n = RankReplies(stm, reply, ponderReplies);
+      memset(spent, 0, sizeof(spent));
+printf("# ponder on"); for(i=0; i<n; i++) printf(" %s", MoveToText(reply[i], 0)); printf("\n");
+      for(ponderDepth = 1; n > 1 && ponderDepth < maxDepth; ponderDepth++) { // rounds of searching all to same depth
+        for(i=0; i<n; i++) {
+          stm = MakeMove2(stm, ponderMove = reply[i]);                // play speculative move
+          gameMove[moveNr++] = reply[i];                              // remember in game
+          sprintf(ponderMoveText, "%s\n", MoveToText(reply[i], 0));  // for detecting ponder hits
+          t = GetTickCount();
+          *score = SearchBestMove(stm, move, &ponderMove, retMSP);
+          if(abortFlag != -1) { PonderResult(reply, spent, n, i, t); ponderDepth = 0; return stm; } // opponent moved, or other input
+          spent[i] += GetTickCount() - t;
+          UnMake2(INVALID); moveNr--; stm ^= WHITE;                   // round done: take back for next reply
+        }
+      }
+      ponderDepth = 0; // single search on likeliest reply
+      stm = MakeMove2(stm, ponderMove = reply[0]);
+      gameMove[moveNr++] = reply[0];
+      sprintf(ponderMoveText, "%s\n", MoveToText(reply[0], 0));
+printf("# ponder=%s", ponderMoveText);
+      t = GetTickCount();
+      *score = SearchBestMove(stm, move, &ponderMove, retMSP);
+      if(abortFlag != -1) PonderResult(reply, spent, n, 0, t);
+      return stm;
+    }
+
+#if !defined(WIN32) && !defined(LIBHACHU)
+    // SELF-PLAY: games between two option sets, played by forked workers; results streamed to file, with SPRT
+
+    #define SPRT_BOUND 2.944 /* log((1-beta)/alpha) for alpha = beta = 0.05 */
+    #define ADJUDICATE 1000  /* score for which game is adjudicated when it persists 6 plies */
+
+    char selfOpt[2][1000];   // option settings for players A and B, separated by ';'
+    HashBucket *selfHash[2]; // each player has its own hash table
+
+    void SetPlayer(int player, int *saved)
+    { // reset options to the values at start of the match, and apply those of given player
+      char *s = selfOpt[player], *q;
+      Options(saved, 1);
+      while(*s) {
+        char buf[200];
+        for(q=buf; *s && *s != ';' && q < buf+199; ) *q++ = *s++;
+        *q = 0; if(*s) s++;
+        if(*buf && !ParseOption(buf)) fprintf(stderr, "selfplay: unknown option '%s'\n", buf);
+      }
+      hashTable = selfHash[player];
+    }
+
+    int PlayGame(char *fen, int aFirst, int limit, int *saved, int *plies)
+    { // play one game from given position (NULL = start position); return score for player A (0-2)
+      Color stm, aColor;
+      Move move, dummy;
+      char buf[4000];
+      int i, reps, score, lastScore = 0, adj = 0;
+      Init(SAME);
+      if(fen) strncpy(buf, fen, 3999), buf[3999] = 0;
+      stm = SetUp2(fen ? buf : NULL); aColor = aFirst ? stm : INVERT(stm);
+      repStack[LEVELS-1] = hashKeyH, checkStack[LEVELS-1] = 0;
+      for(i=0; i<2; i++) memset(selfHash[i], 0, (hashMask+1)*sizeof(HashBucket));
+      while(1) {
+        if(moveNr >= MAXMOVES-1 || moveNr >= 50*bFiles) { reason = "game too long"; score = 1; break; }
+        if(repDraws && cnt50 >= 2*FIFTY) { reason = "fifty-move rule"; score = 1; break; }
+        for(i=2, reps=0; i<=cnt50 && i<LEVELS; i+=2) reps += (repStack[LEVELS-1-i] == hashKeyH);
+        if(reps >= 2) { reason = "repetition"; score = 1; break; }
+        SetPlayer(stm != aColor, saved);
+        retMSP = ListMoves(stm, retFirst, 0); abortFlag = 0;
+        startTime = GetTickCount();
+        if(nodeLimit) tlim1 = tlim2 = tlim3 = 1<<30; else tlim1 = limit/2, tlim2 = tlim3 = limit;
+        score = SearchBestMove(stm, &move, &dummy, retMSP);
+        if(stm != aColor) score = -score; // from now on from A's perspective
+        adj = (score >= ADJUDICATE || score <= -ADJUDICATE ? (score > 0) == (lastScore > 0) ? adj + 1 : 1 : 0); lastScore = score;
+        if(adj >= 6) { reason = "adjudication"; score = 1 + (score > 0) - (score < 0); break; }
+        if(move == INVALID) { // game ended: mated (score < 0) or King capture (score > 0), as in main()
+          reason = KingCapture(stm) != ABSENT ? "king capture" : score ? "resign" : "no moves";
+          score = 1 + (score > 0) - (score < 0);
+          break;
+        }
+        stm = MakeMove2(stm, move);
+        gameMove[moveNr++] = move;
+      }
+      *plies = moveNr;
+      return score;
+    }
+
+    double LLR(int w, int d, int l, double elo0, double elo1)
+    { // log-likelihood ratio of H1 (elo1) vs H0 (elo0), in normal approximation of trinomial distribution
+      double n = w + d + l, m, v, s0, s1;
+      if(!w || !l) return 0.; // variance estimate not meaningful yet
+      m = (w + d/2.)/n;
+      v = (w*(1-m)*(1-m) + d*(0.5-m)*(0.5-m) + l*m*m)/n;
+      s0 = 1/(1 + pow(10., -elo0/400)); s1 = 1/(1 + pow(10., -elo1/400));
+      return (s1 - s0)*(2*m - s0 - s1)*n/(2*v);
+    }
+
+    void SelfPlay(char *args)
+    { // selfplay games=N workers=N nodes=N|ms=N book=FILE out=FILE elo0=X elo1=X
+      static char *fens[1000];
+      char *tok, book[200] = "", out[200] = "selfplay.txt", line[4000];
+      int games = 100, workers = 1, nodes = 20000, ms = 0, nFens = 0, saved[NOPTS], fd[2], w, res[3] = {0, 0, 0}, n = 0;
+      double elo0 = 0, elo1 = 5, llr = 0;
+      pid_t pid[64];
+      FILE *f;
+      for(tok=strtok(args, " \n"); tok; tok=strtok(NULL, " \n")) {
+        sscanf(tok, "games=%d", &games); sscanf(tok, "workers=%d", &workers);
+        sscanf(tok, "nodes=%d", &nodes); sscanf(tok, "ms=%d", &ms);
+        sscanf(tok, "book=%199s", book); sscanf(tok, "out=%199s", out);
+        sscanf(tok, "elo0=%lf", &elo0);  sscanf(tok, "elo1=%lf", &elo1);
+      }
+      workers = MAX(1, MIN(workers, 64));
+      if(*book && (f = fopen(book, "r"))) { // opening FENs, one per line
+        while(nFens < 1000 && fgets(line, 4000, f)) if(*line != '#' && *line != '\n') fens[nFens++] = strdup(line);
+        fclose(f);
+      } else if(*book) { printf("# cannot open %s\n", book); return; }
+      if(!(f = fopen(out, "w"))) { printf("# cannot open %s\n", out); return; }
+      fprintf(f, "# %d games, %s %d, A: %s, B: %s, SPRT elo0=%g elo1=%g\n", games,
+              ms ? "ms" : "nodes", ms ? ms : nodes, selfOpt[0], selfOpt[1], elo0, elo1);
+      fflush(f); fflush(stdout);
+      Options(saved, 0);
+      if(pipe(fd)) { perror("pipe"); fclose(f); return; }
+      for(w=0; w<workers; w++) {
+        if((pid[w] = fork()) == 0) { // worker: play every workers-th game, report each result on pipe
+          int g, plies, score;
+          close(fd[0]); freopen("/dev/null", "w", stdout);
+          selfHash[0] = hashTable; selfHash[1] = malloc((hashMask+1)*sizeof(HashBucket));
+          if(!selfHash[1]) _exit(1);
+          nodeLimit = ms ? 0 : nodes; maxDepth = MAXPLY; postThinking = OFF; ponder = OFF; randomize = OFF;
+          for(g=w; g<games; g+=workers) { // pairs of games from same opening, with colors reversed
+            int len;
+            score = PlayGame(nFens ? fens[g/2 % nFens] : NULL, !(g & 1), ms, saved, &plies);
+            len = sprintf(line, "%d %d %d %s\n", g, score, plies, reason);
+            if(write(fd[1], line, len) != len) break; // parent stopped listening
+          }
+          _exit(0);
+        }
+        if(pid[w] < 0) { workers = w; break; }
+      }
+      close(fd[1]);
+      { FILE *in = fdopen(fd[0], "r");
+        static char *result[] = { "A loses", "draw", "A wins" };
+        int g, score, plies;
+        char why[100];
+        while(fgets(line, 4000, in)) {
+          if(sscanf(line, "%d %d %d %99[^\n]", &g, &score, &plies, why) != 4) continue;
+          res[score]++; n++;
+          llr = LLR(res[2], res[1], res[0], elo0, elo1);
+          fprintf(f, "game %d (A %s): %s {%s} %d plies; +%d =%d -%d LLR %.2f\n",
+                  g+1, g & 1 ? "second" : "first", result[score], why, plies, res[2], res[1], res[0], llr);
+          fflush(f);
+          if(llr >= SPRT_BOUND || llr <= -SPRT_BOUND) break;
+        }
+        for(w=0; w<workers; w++) kill(pid[w], SIGTERM), waitpid(pid[w], NULL, 0);
+        fclose(in);
+      }
+      fprintf(f, "# %d games: +%d =%d -%d, LLR %.2f (%.2f, %.2f): %s\n", n, res[2], res[1], res[0], llr, -SPRT_BOUND, SPRT_BOUND,
+              llr >= SPRT_BOUND ? "H1 accepted" : llr <= -SPRT_BOUND ? "H0 accepted" : "inconclusive");
+      fclose(f);
+      printf("# selfplay %d games: +%d =%d -%d, LLR %.2f %s\n", n, res[2], res[1], res[0], llr,
+              llr >= SPRT_BOUND ? "H1 accepted" : llr <= -SPRT_BOUND ? "H0 accepted" : "inconclusive");
+    }
+
+    // BATCH ANALYSIS: FEN/EPD positions analyzed by forked workers; one JSON record per position, EPD bm/am scored
+
+    char *JsonString(char *buf, int size, char *s)
+    { // s in buf as body of a JSON string: quotes, backslashes and control characters escaped, truncated to fit
+      char *q = buf;
+      for(; *s && q < buf + size - 7; s++) {
+        if(*s == '"' || *s == '\\') *q++ = '\\', *q++ = *s;
+        else if((unsigned char) *s < ' ') q += sprintf(q, "\\u%04x", *s);
+        else *q++ = *s;
+      }
+      *q = 0;
+      return buf;
+    }
+
+    int AnalyzeLine(char *line, int n, int depth, int nodeMax, int ms, char *json)
+    { // analyze one position (with EPD operations overruling the default budget); JSON result in json, -2 if unreadable
+      static char *opcodes[] = { "bm", "am", "id", "acd", "acn", "acs", NULL };
+      char fen[1000], id[100] = "", tok[200], pvText[2000], *s = line, *q = fen;
+      char jsId[200], jsFen[1100], jsPv[2000]; // escaped versions: with the rest they fit in the 3600 of json
+      int i, op = -1, score, time;
+      Color stm;
+      Move move, dummy;
+      for(i=0; i<2; i++) { // FEN board and side-to-move fields; the other FEN fields are ignored
+        while(*s == ' ' || *s == '\t') s++;
+        while(*s && !strchr(" \t\r\n", *s) && q < fen+990) *q++ = *s++;
+        *q++ = ' ';
+      }
+      q[-1] = 0;
+      *testMoves[0] = *testMoves[1] = 0;
+      while(*s) { // EPD operations: opcode operand ... ;
+        int end = 0;
+        while(*s && strchr(" \t\r\n", *s)) s++;
+        if(!*s) break;
+        q = tok;
+        if(*s == '"') { for(s++; *s && *s != '"'; s++) if(q < tok+199 && *s != '\\') *q++ = *s; if(*s) s++; }
+        else for(; *s && !strchr(" \t\r\n;", *s); s++) if(q < tok+199 && *s != '"' && *s != '\\') *q++ = *s;
+        *q = 0;
+        if(*s == ';') end = 1, s++;
+        if(op < 0) { for(i=0; opcodes[i] && strcmp(tok, opcodes[i]); i++) {} if(opcodes[i]) op = i; }
+        else if(op < 2) { // bm or am
+          if(strlen(testMoves[op]) + strlen(tok) < 195) sprintf(testMoves[op] + strlen(testMoves[op]), "%s%s ", *testMoves[op] ? "" : " ", tok);
+        } else if(op == 2) snprintf(id, 100, "%s", tok);
+        else if(op == 3) depth = atoi(tok);
+        else if(op == 4) nodeMax = atoi(tok);
+        else ms = 1000*atof(tok);
+        if(end) op = -1;
+      }
+      JsonString(jsId, 200, id); JsonString(jsFen, 1100, fen);
+      if(setjmp(fatalJump)) { // SetUp2() rejected the FEN
+        fatalCatch = 0;
+        sprintf(json, "{\"n\":%d,\"id\":\"%s\",\"fen\":\"%s\",\"error\":\"invalid position\"}", n+1, jsId, jsFen);
+        return -2;
+      }
+      fatalCatch = 1;
+      Init(SAME);
+      stm = SetUp2(fen);
+      fatalCatch = 0;
+      repStack[LEVELS-1] = hashKeyH, checkStack[LEVELS-1] = 0;
+      memset(hashTable, 0, (hashMask+1)*sizeof(HashBucket)); // every position is analyzed from scratch, so results
+      memset(qsTable, 0, QSHASH*sizeof(HashBucket));         // do not depend on how positions are divided over workers
+      retMSP = ListMoves(stm, retFirst, 0); abortFlag = 0;
+      maxDepth = depth; nodeLimit = nodeMax; tlim1 = tlim2 = tlim3 = (ms ? ms : 1<<30);
+      solveTime = -1; rootDepth = 0;
+      score = SearchBestMove(stm, &move, &dummy, retMSP);
+      time = GetTickCount() - startTime;
+      for(i=0, *pvText=0; move != INVALID && pv[i] && strlen(pvText) < 1980; i++)
+        sprintf(pvText + strlen(pvText), "%s%s", i ? " " : "", MoveToText(pv[i], 0));
+      sprintf(json, "{\"n\":%d,\"id\":\"%s\",\"fen\":\"%s\",\"score\":%d,\"depth\":%d,\"nodes\":%d,\"time\":%d,\"pv\":\"%s\"",
+              n+1, jsId, jsFen, score, rootDepth, nodes, time, JsonString(jsPv, 2000, pvText));
+      if(*testMoves[0] || *testMoves[1])
+        sprintf(json + strlen(json), ",\"solved\":%s,\"solveTime\":%d,\"solveDepth\":%d", solveTime >= 0 ? "true" : "false",
+                solveTime, solveTime >= 0 ? solveDepth : -1);
+      strcat(json, "}");
+      return (*testMoves[0] || *testMoves[1] ? solveTime >= 0 : -1);
+    }
+
+    void Batch(char *args)
+    { // batch FILE out=FILE workers=N depth=N nodes=N ms=N
+      static char **lines;
+      char *tok, in[200] = "", out[200] = "batch.json", line[4100];
+      int workers = sysconf(_SC_NPROCESSORS_ONLN), depth = 0, nodeMax = 0, ms = 0, nLines = 0, fd[2], w, n = 0;
+      int tested = 0, solved = 0, errors = 0, start = GetTickCount();
+      char *done;
+      double solveSum = 0;
+      pid_t pid[64];
+      FILE *f;
+      for(tok=strtok(args, " \n"); tok; tok=strtok(NULL, " \n")) {
+        if(!strchr(tok, '=')) strncpy(in, tok, 199);
+        sscanf(tok, "out=%199s", out); sscanf(tok, "workers=%d", &workers);
+        sscanf(tok, "depth=%d", &depth); sscanf(tok, "nodes=%d", &nodeMax); sscanf(tok, "ms=%d", &ms);
+      }
+      workers = MAX(1, MIN(workers, 64));
+      if(!depth && !nodeMax && !ms) depth = 10; // some limit is needed
+      if(!depth) depth = MAXPLY;
+      if(!(f = fopen(in, "r"))) { printf("# cannot open '%s'\n", in); return; }
+      for(w=1000; fgets(line, 4000, f); ) { // read all positions; the workers inherit them
+        if(*line == '#' || *line == '\n' || *line == '\r') continue;
+        if(nLines >= w || !lines) lines = realloc(lines, (w *= 2)*sizeof(char*));
+        lines[nLines++] = strdup(line);
+      }
+      fclose(f);
+      if(!(f = fopen(out, "w"))) { printf("# cannot open %s\n", out); return; }
+      if(!hashMask) SetMemorySize(64);
+      fflush(stdout);
+      if(pipe(fd)) { perror("pipe"); fclose(f); return; }
+      done = calloc(nLines + 1, 1); // positions reported by the workers
+      for(w=0; w<workers; w++) {
+        if((pid[w] = fork()) == 0) { // worker: analyze every workers-th position, report each on the pipe in one write
+          int i, len, res;
+          char json[3600]; // fits in PIPE_BUF with header, so lines of different workers cannot interleave
+          close(fd[0]); freopen("/dev/null", "w", stdout);
+          postThinking = OFF; ponder = OFF; randomize = OFF; pvCuts = noCut;
+          for(i=w; i<nLines; i+=workers) {
+            res = AnalyzeLine(lines[i], i, depth, nodeMax, ms, json);
+            len = sprintf(line, "%d %d %d %s\n", i, res, solveTime, json); // header for parent in front of JSON
+            if(write(fd[1], line, len) != len) break; // parent stopped listening
+          }
+          _exit(0);
+        }
+        if(pid[w] < 0) { workers = w; break; }
+      }
+      close(fd[1]);
+      { FILE *in = fdopen(fd[0], "r");
+        int i, res, t, k;
+        while(fgets(line, 4100, in)) {
+          if(sscanf(line, "%d %d %d %n", &i, &res, &t, &k) != 3 || i < 0 || i >= nLines) continue;
+          fputs(line + k, f); fflush(f);
+          n++; done[i] = 1;
+          if(res == -2) errors++; else if(res >= 0) tested++;
+          if(res > 0) solved++, solveSum += t;
+        }
+        for(w=0; w<workers; w++) waitpid(pid[w], NULL, 0);
+        fclose(in);
+        for(i=0; i<nLines; i++) if(!done[i]) { // its worker died on it (or on an earlier one)
+          fprintf(f, "{\"n\":%d,\"error\":\"not analyzed\"}\n", i+1);
+          n++; errors++;
+        }
+        free(done);
+      }
+      fprintf(f, "{\"positions\":%d,\"errors\":%d,\"tested\":%d,\"solved\":%d,\"solveRate\":%.1f,\"avgSolveTime\":%.0f,\"time\":%d}\n",
+              n, errors, tested, solved, tested ? 100.*solved/tested : 0., solved ? solveSum/solved : 0., GetTickCount() - start);
+      fclose(f);
+      printf("# batch %d positions", n);
+      if(errors) printf(", %d not analyzed", errors);
+      if(tested) printf(", solved %d of %d (%.1f%%), average time to solution %.0f ms", solved, tested, 100.*solved/tested, solved ? solveSum/solved : 0.);
+      printf("\n");
+      for(w=0; w<nLines; w++) free(lines[w]);
+      nLines = 0;
+    }
+#endif
+
+#ifndef LIBHACHU
     int
     main ()
     {
@@ -1182,30 +2096,20 @@ printf("# ponder hit\n");
         abortFlag = -(ponder && INVERT(stm) == engineSide && moveNr); // pondering and opponent on move
         if(stm == engineSide || abortFlag && ponderMove) {         // if it is the engine's turn to move, set it thinking, and let it move
 printf("# start %s: stm=%d engine=%d ponder=%d\n", abortFlag == -1 ? "ponder" : "search", stm, engineSide, ponder);
-          if(abortFlag) {
-            stm = MakeMove2(stm, ponderMove);                           // for pondering, play speculative move
-            gameMove[moveNr++] = ponderMove;                            // remember in game
-            sprintf(ponderMoveText, "%s\n", MoveToText(ponderMove, 0)); // for detecting ponder hits
-printf("# ponder=%s\n", ponderMoveText);
-          } else SetSearchTimes(10*timeLeft);                           // for thinking, schedule end time
+          if(abortFlag) stm = Ponder(stm, &move, &score);             // for pondering, play speculative move(s) and search
+          else {
+            SetSearchTimes(10*timeLeft);                                // for thinking, schedule end time
 #if 0
 pboard(board);
 #endif
-          score = SearchBestMove(stm, &move, &ponderMove, retMSP);
+            score = SearchBestMove(stm, &move, &ponderMove, retMSP);
+          }
           if(abortFlag == 1) { // ponder search was interrupted (and no hit)
             UnMake2(INVALID); moveNr--; stm ^= WHITE;    // take ponder move back if we made one
             abortFlag = 0;
           } else if(move == INVALID) {                   // game apparently ended
-            int kcapt = 0, king, k = p[king=royal[INVERT(stm)]].pos;
-            if( k != ABSENT) { // test if King capture possible
-              if(ATTACK(k, stm)) {
-                if( p[king + 2].pos == ABSENT ) kcapt = 1; // we have an attack on his only King
-              }
-            } else { // he has no king! Test for attacks on Crown Prince
-              k = p[king + 2].pos;
-              if(ATTACK(k, stm)) kcapt = 1; // we have attack on Crown Prince
-            }
-            if(kcapt) { // print King capture before claiming
+            int k = KingCapture(stm);
+            if(k != ABSENT) { // print King capture before claiming
               int msp = GenCapts(stm, k, 0, retMSP);
               printf("move %s\n", MoveToText(moveStack[msp-1], 1));
               reason = "king capture";
@@ -1255,36 +2159,36 @@ pboard(board);
             printf("%s%s", (i ? "," : "feature variants=\""), variants[i].name);
           printf("\"\n");
           printf("feature ping=1 setboard=1 colors=0 usermove=1 memory=1 debug=1 sigint=0 sigterm=0\n");
-          printf("feature myname=\"HaChu " VERSION "\" highlight=1\n");
+          printf("feature myname=\"HaChu " VERSION "\" highlight=1 egt=\"hachu\"\n");
           printf("feature option=\"Full analysis PV -check %d\"\n", noCut); // example of an engine-defined option
           printf("feature option=\"Allow repeats -check %d\"\n", allowRep);
           printf("feature option=\"Promote on entry -check %d\"\n", entryProm);
           printf("feature option=\"Okazaki rule -check %d\"\n", okazaki);
+          printf("feature option=\"QS checks -check %d\"\n", qsChecks);
+          printf("feature option=\"Pruning margin -spin %d 0 400\"\n", pruneScale);
+          printf("feature option=\"Null-move reduction -spin %d 1 6\"\n", nullR);
+          printf("feature option=\"Null-move verification depth -spin %d 0 60\"\n", verifyDepth);
+          printf("feature option=\"Ponder replies -spin %d 1 %d\"\n", ponderReplies, MAXREPLIES);
+          printf("feature option=\"MCTS variants -string %s\"\n", mctsVariants);
+          printf("feature option=\"MCTS workers -spin %d 1 64\"\n", mctsWorkers);
+          printf("feature option=\"MCTS tree MB -spin %d 1 4096\"\n", mctsMB);
+          printf("feature option=\"MCTS playout plies -spin %d 0 20\"\n", mctsPlies);
           printf("feature option=\"Resign -check %d\"\n", resign);
           printf("feature option=\"Contempt -spin %d -200 200\"\n", contemptFactor); // and another one
           printf("feature option=\"Tsume -combo no /// Sente mates /// Gote mates\"\n");
           printf("feature done=1\n");
           continue;
         }
-        if(!strcmp(command, "option")) { // setting of engine-define option; find out which
-          if(sscanf(inBuf+7, "Full analysis PV=%d", &noCut)  == 1) continue;
-          if(sscanf(inBuf+7, "Allow repeats=%d", &allowRep)  == 1) continue;
-          if(sscanf(inBuf+7, "Resign=%d",   &resign)         == 1) continue;
-          if(sscanf(inBuf+7, "Contempt=%d", &contemptFactor) == 1) continue;
-          if(sscanf(inBuf+7, "Okazaki rule=%d", &okazaki)    == 1) continue;
-          if(sscanf(inBuf+7, "Promote on entry=%d", &entryProm) == 1) continue;
-          if(sscanf(inBuf+7, "Tsume=%s", command) == 1) {
-            if(!strcmp(command, "no"))    tsume = 0; else
-            if(!strcmp(command, "Sente")) tsume = 1; else
-            if(!strcmp(command, "Gote"))  tsume = 2;
-            continue;
-          }
-          continue;
-        }
+        if(!strcmp(command, "option"))  { ParseOption(inBuf+7); continue; } // setting of engine-defined option
         if(!strcmp(command, "sd"))      { sscanf(inBuf, "sd %d", &maxDepth);    continue; }
         if(!strcmp(command, "st"))      { sscanf(inBuf, "st %d", &timePerMove); continue; }
 
         if(!strcmp(command, "memory"))  { SetMemorySize(atoi(inBuf+7)); continue; }
+        if(!strcmp(command, "egtpath")) { // endgame tables made by tbgen
+          char type[20], dir[200];
+          if(sscanf(inBuf, "egtpath %19s %199[^\n]", type, dir) == 2 && !strcmp(type, "hachu")) TBPath(dir);
+          continue;
+        }
         if(!strcmp(command, "ping"))    { printf("pong%s", inBuf+4); continue; }
     //  if(!strcmp(command, ""))        { sscanf(inBuf, " %d", &); continue; }
         if(!strcmp(command, "easy"))    { ponder = OFF; continue; }
@@ -1301,6 +2205,21 @@ pboard(board);
         if(!strcmp(command, "w"))       { MapAttacksByColor(WHITE, pieces[WHITE], level); pmap(WHITE); continue; }
         if(!strcmp(command, "b"))       { MapAttacksByColor(BLACK, pieces[BLACK], level); pmap(BLACK); continue; }
         if(!strcmp(command, "l"))       { pplist(); continue; }
+        if(!strcmp(command, "stats"))   { PrintStats(); continue; }
+#ifndef WIN32
+        if(!strcmp(command, "selfopt")) { // option for self-play player: selfopt A|B Name=value
+          char c; int n = 0;
+          if(sscanf(inBuf, "selfopt %c %n", &c, &n) == 1 && n && (c == 'A' || c == 'B')) {
+            char *q = strchr(inBuf + n, '\n'); if(q) *q = 0;
+            if(*selfOpt[c-'A']) strcat(selfOpt[c-'A'], ";");
+            strncat(selfOpt[c-'A'], inBuf + n, 998 - strlen(selfOpt[c-'A']));
+          } else *selfOpt[0] = *selfOpt[1] = 0; // no valid argument: clear both
+          continue;
+        }
+        if(!strcmp(command, "selfplay")){ SelfPlay(inBuf+8); continue; } // games are played in forked processes
+        if(!strcmp(command, "batch"))   { Batch(inBuf+5); continue; } // positions are analyzed in forked processes
+#endif
+        if(!strcmp(command, "trace"))   { if(sscanf(inBuf, "trace %79s", command) != 1) strcpy(command, "hachu.trc"); WriteTrace(command); continue; }
         // ignored commands:
         if(!strcmp(command, "xboard"))  { continue; }
         if(!strcmp(command, "computer")){ comp = 1; continue; }
@@ -1379,4 +2298,4 @@ pboard(board);
       }
       return 0;
     }
-
+#endif
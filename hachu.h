@@ -10,6 +10,12 @@
 
 #define VERSION "0.23"
 
+// some parameters of your engine
+#define MAXMOVES 2000 /* maximum game length  */
+#define MAXPLY   60   /* maximum search depth */
+#define NOPTS    15   /* number of engine-defined options (see Options) */
+#define MAXREPLIES 8  /* most opponent replies pondered on */
+
 // promotion codes
 #define CAN_PROMOTE 0x11
 #define DONT_DEFER  0x22
@@ -25,10 +31,29 @@ int myRandom();
 
 // Some routines your engine should have to do the various essential things
 Color MakeMove2(Color stm, Move move); // performs move, and returns new side to move
-Flag InCheck(Color stm, int level); // generates attack maps, and determines if king/prince is in check
+Flag InCheck(Color stm);            // determines if king/prince is in check, without touching the attack maps
 void UnMake2(Move move);            // unmakes the move;
-Color Setup2(char *fen);            // sets up the position from the given FEN, and returns the new side to move
+Color SetUp2(char *fen);            // sets up the position from the given FEN, and returns the new side to move
 int ListMoves(Color stm, int listStart, int listEnd);
 void SetMemorySize(int n);          // if n is different from last time, resize all tables to make memory usage below n MB
 int SearchBestMove(Color stm, Move *move, Move *ponderMove, int msp);
+int RankReplies(Color stm, Move *reply, int n); // replies to ponder on, likeliest first
+void SearchStart(Color stm, int alpha, int beta, int difEval, int depth, int lmr, Move oldPromo, Move promoSuppress, int threshold, int msp);
+int SearchRun(int budget);          // searches at most budget nodes of tree set up by SearchStart; returns 1 when done (score in searchScore)
+int Quiesce(Color stm, int msp);    // score of current position by quiescence search, without output
+char TerminationCheck(Color stm);   // sets abortFlag on input (while pondering), or when time or nodes run out
+int ParseOption(char *s);           // sets engine-defined option from text Name=value; returns 0 if not recognized
+void Options(int *v, int set);      // gets (set = 0) or sets all engine-defined options
+void ClearHistory();                // forgets killers and history of the previous game
+
+// driver state
+extern THREAD int moveNr, retFirst, retMSP, maxDepth, nodes, nodeLimit, startTime, tlim1, tlim2, tlim3;
+extern THREAD int ponder, randomize, postThinking, pvCuts, noCut, rootDepth, lastRootIter, hashMask, searchScore;
+extern THREAD char abortFlag;
+extern THREAD Move gameMove[MAXMOVES], moveStack[30000], repeatMove[], repStack[], pv[1000], retMove;
+extern THREAD Flag checkStack[];
+extern THREAD UndoInfo undoInfo;      // of last MakeMove2
+#ifndef WIN32
+int GetTickCount();                   // wall-clock time (ms)
+#endif
 #endif
@@ -0,0 +1,226 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Reentrant C API of the library build (see libhachu.h). Only compiled with -DLIBHACHU.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "board.h"
+#include "eval.h"
+#include "hachu.h"
+#include "libhachu.h"
+#include "move.h"
+#include "piece.h"
+#include "types.h"
+#include "variant.h"
+
+struct HachuGame {
+  int id, version;      // identify game and its state, to see if the thread's engine already has it set up
+  int var;              // index in variants[]
+  char fen[4000];       // start position ("" = that of variant)
+  int opts[NOPTS];      // engine-defined options
+  int nrMoves;
+  Move moves[MAXMOVES];
+  HashBucket *hash, *realHash; // own hash table (NULL = that of the searching thread)
+  int hashMask;
+};
+
+THREAD jmp_buf fatalJump;         // SetUp returns here on invalid FEN
+int sharedSquareKey[BSIZE];       // hash keys are the same in every thread
+extern THREAD HashBucket *hashTable;
+static THREAD FILE *logFile;
+static THREAD int curId = -1, curVersion; // game the engine of this thread is set up for
+static THREAD Color curStm;
+static int defaultOpts[NOPTS], nextId;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+int
+hachu_printf (const char *fmt, ...)
+{ // replaces printf in the library: engine output only goes to log
+  va_list ap;
+  int n;
+  if(!logFile) return 0;
+  va_start(ap, fmt);
+  n = vfprintf(logFile, fmt, ap);
+  va_end(ap);
+  return n;
+}
+
+static void
+LibInit ()
+{ // create all hash keys of pieces before any thread can use them, as the descriptors are shared
+  static PieceDesc *lists[] = { chuPieces, shogiPieces, daiPieces, waPieces, ddPieces, makaPieces, taiPieces, tenjikuPieces,
+                                taikyokuPieces, chessPieces, lionPieces, shatranjPieces, makrukPieces, wolfPieces, NULL };
+  PieceDesc **l, *d;
+  int i;
+  for(i=0; i<BSIZE; i++) sharedSquareKey[i] = ~(myRandom()*myRandom());
+  for(l=lists; *l; l++) for(d=*l; d->name; d++) PieceKey(WHITE, d), PieceKey(BLACK, d);
+  Options(defaultOpts, 0);
+}
+
+static Color
+Position (HachuGame *g)
+{ // set up the game in the engine of the calling thread, if it does not have it already
+  // can FATAL(), so callers must have done setjmp(fatalJump)
+  char buf[4000];
+  if(g->id == curId && g->version == curVersion) return curStm;
+  if(g->id != curId) ClearHistory(); // move-ordering tables are per thread: do not carry them over from another game
+  curId = -1; // until the set-up has completed
+  Init(g->var);
+  curStm = SetUp2(*g->fen ? strcpy(buf, g->fen) : NULL); // was validated by hachu_setboard
+  repStack[LEVELS-1] = hashKeyH, checkStack[LEVELS-1] = 0;
+  for(moveNr=0; moveNr<g->nrMoves; moveNr++) curStm = MakeMove2(curStm, gameMove[moveNr] = g->moves[moveNr]);
+  Options(g->opts, 1);
+  curId = g->id; curVersion = g->version;
+  return curStm;
+}
+
+HachuGame *
+hachu_new (const char *variant)
+{
+  HachuGame *g;
+  int i;
+  pthread_once(&once, LibInit);
+  for(i=0; variants[i].boardRanks && strcmp(variants[i].name, variant); i++) {}
+  if(!variants[i].boardRanks) return NULL;
+  if(variants[i].boardFiles > BW-2 || variants[i].boardRanks > BH-2) return NULL; // no room for edge guards
+  curId = -1; // try the start position, so that the other calls cannot fail on it
+  if(setjmp(fatalJump)) return NULL;
+  Init(i); SetUp2(NULL);
+  if(!(g = malloc(sizeof(HachuGame)))) return NULL;
+  g->id = __sync_fetch_and_add(&nextId, 1); g->version = 0;
+  g->var = i; *g->fen = 0; g->nrMoves = 0;
+  g->hash = g->realHash = NULL; g->hashMask = 0;
+  memcpy(g->opts, defaultOpts, sizeof(defaultOpts));
+  return g;
+}
+
+void
+hachu_free (HachuGame *g)
+{
+  if(g) free(g->realHash);
+  free(g);
+}
+
+int
+hachu_setboard (HachuGame *g, const char *fen)
+{
+  char buf[4000];
+  if(fen && strlen(fen) >= sizeof(buf)) return -1;
+  curId = -1; // whatever happens, the engine no longer has a game set up
+  if(setjmp(fatalJump)) return -1;
+  Init(g->var);
+  SetUp2(fen ? strcpy(buf, fen) : NULL);
+  strcpy(g->fen, fen ? fen : ""); g->nrMoves = 0; g->version++;
+  return 0;
+}
+
+int
+hachu_move (HachuGame *g, const char *move)
+{
+  char buf[80];
+  Color stm;
+  Move m;
+  if(setjmp(fatalJump)) return -1;
+  stm = Position(g);
+  if(g->nrMoves >= MAXMOVES-1) return -1;
+  snprintf(buf, sizeof(buf), "%s\n", move); // ParseMove wants text as the protocol delivers it
+  retMSP = ListMoves(stm, retFirst, 0);
+  m = ParseMove(stm, retFirst, retMSP, buf, moveStack, repeatMove, &retMSP);
+  if(m == INVALID) return -1;
+  curStm = MakeMove2(stm, gameMove[moveNr++] = m); // engine follows game, so it needs no new set-up
+  g->moves[g->nrMoves++] = m; curVersion = ++g->version;
+  return 0;
+}
+
+int
+hachu_undo (HachuGame *g, int n)
+{
+  g->nrMoves -= MIN(MAX(n, 0), g->nrMoves); g->version++;
+  return g->nrMoves;
+}
+
+int
+hachu_moves (HachuGame *g, char *buf, int size)
+{
+  Color stm;
+  int i, n = 0, len = 0;
+  if(size > 0) *buf = 0;
+  if(setjmp(fatalJump)) return -1;
+  stm = Position(g);
+  retMSP = ListMoves(stm, retFirst, 0);
+  for(i=retFirst; i<retMSP; i++) if(moveStack[i] != INVALID) {
+    char *s = MoveToText(moveStack[i], 0);
+    if(len + strlen(s) + 2 > size) break;
+    len += sprintf(buf + len, "%s%s", n++ ? " " : "", s);
+  }
+  return n;
+}
+
+int
+hachu_option (HachuGame *g, const char *setting)
+{
+  char buf[200];
+  if(setjmp(fatalJump)) return -1;
+  Position(g);
+  snprintf(buf, sizeof(buf), "%s", setting);
+  if(!ParseOption(buf)) return -1;
+  Options(g->opts, 0); curVersion = ++g->version;
+  return 0;
+}
+
+int
+hachu_search (HachuGame *g, int depth, int nodeMax, int ms, char *move, char *ponderText)
+{
+  Color stm;
+  Move m, pm;
+  HashBucket *threadHash;
+  int score, threadMask;
+  *move = 0; if(ponderText) *ponderText = 0;
+  if(setjmp(fatalJump)) return HACHU_FAIL;
+  stm = Position(g);
+  if(!hashMask) SetMemorySize(64);
+  threadHash = hashTable; threadMask = hashMask;
+  if(g->hash) hashTable = g->hash, hashMask = g->hashMask; // search with the table of the game
+  if(!depth && !nodeMax && !ms) depth = 10; // some limit is needed
+  retMSP = ListMoves(stm, retFirst, 0); abortFlag = 0;
+  maxDepth = depth ? depth : MAXPLY; nodeLimit = nodeMax; tlim1 = tlim2 = tlim3 = (ms ? ms : 1<<30);
+  postThinking = (logFile != NULL); ponder = randomize = 0;
+  score = SearchBestMove(stm, &m, &pm, retMSP);
+  hashTable = threadHash; hashMask = threadMask;
+  strcpy(move, m == INVALID ? "" : MoveToText(m, 0));
+  if(ponderText) strcpy(ponderText, m == INVALID || !pm ? "" : MoveToText(pm, 0));
+  return score;
+}
+
+int
+hachu_hash (HachuGame *g, int mb)
+{ // give game a hash table of its own, of the same size SetMemorySize would make (mb = 0: use that of the thread)
+  intptr_t m = 1;
+  free(g->realHash); g->hash = g->realHash = NULL; g->hashMask = 0;
+  if(mb <= 0) return 0;
+  while(m*sizeof(HashBucket) <= mb*512UL) m <<= 1; // take largest power-of-2 that fits
+  if(!(g->realHash = calloc(m*1024*sizeof(HashBucket) + 64, 1))) return -1;
+  g->hash = (HashBucket*) ((intptr_t) g->realHash + 63 & ~63UL); // align with cache line
+  g->hashMask = m*1024 - 1;
+  return 0;
+}
+
+void
+hachu_memory (int mb)
+{
+  SetMemorySize(mb);
+}
+
+void
+hachu_log (FILE *f)
+{
+  logFile = f;
+}
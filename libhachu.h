@@ -0,0 +1,37 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+#ifndef LIBHACHU_H
+#define LIBHACHU_H
+#include <stdio.h>
+
+// HaChu as a library (libhachu.a / libhachu.so, compiled with -DLIBHACHU)
+//
+// A game handle only holds the game record (variant, start position, moves) and option settings.
+// The engine state is per thread: every call sets up the game in the engine of the calling thread,
+// (which is free when that thread already has it), so any number of games can be served by a pool
+// of threads, each thread with its own hash table. A game can also get a hash table of its own, which
+// then goes with it to whatever thread searches it. A handle must not be used by two threads at once.
+// Moves are text in the notation HaChu uses in the WinBoard protocol (e.g. e2e4, e7e8q, h4h5+).
+
+typedef struct HachuGame HachuGame;
+
+#define HACHU_FAIL (-100000) /* hachu_search: game could not be set up */
+
+HachuGame *hachu_new(const char *variant);            // new game in start position; NULL for unknown or unsupported variant
+void hachu_free(HachuGame *g);
+int  hachu_setboard(HachuGame *g, const char *fen);   // NULL = start position; -1 for invalid position
+int  hachu_move(HachuGame *g, const char *move);      // -1 for illegal move (or game that cannot be set up)
+int  hachu_undo(HachuGame *g, int n);                 // take back n moves; returns number of moves left in game
+int  hachu_moves(HachuGame *g, char *buf, int size);  // legal moves, separated by spaces; returns their number (-1: no set-up)
+int  hachu_option(HachuGame *g, const char *setting); // "Name=value", as in xboard option command; -1 if unknown (or no set-up)
+int  hachu_search(HachuGame *g, int depth, int nodes, int ms, char *move, char *ponder);
+                                                      // returns score for side to move; move "" if there is none
+                                                      // (HACHU_FAIL if the game cannot be set up)
+int  hachu_hash(HachuGame *g, int mb);                // own hash table for game (0 = use that of thread); -1 if no memory
+void hachu_memory(int mb);                            // hash size of the calling thread
+void hachu_log(FILE *f);                              // thinking output of the calling thread (NULL = none)
+#endif
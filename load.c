@@ -0,0 +1,102 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Load generator for the hachud daemon: opens a number of sessions, each playing a game against itself
+// by sending 'go' requests (and the moves they return), and reports throughput and request latency.
+// Usage: hachuload SOCKET [clients=N] [requests=N] [variant=NAME] [depth=N] [nodes=N] [ms=N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+char *path, variant[80] = "chu", goCmd[100];
+int clients = 4, requests = 50, failed;
+double *latency; // ms, requests per client
+
+double
+Now ()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1000. + t.tv_nsec*1e-6;
+}
+
+int
+Ask (int fd, FILE *f, char *cmd, char *reply, int size)
+{ // send command line, and read the reply line to it
+  if(write(fd, cmd, strlen(cmd)) < 0 || !fgets(reply, size, f)) return 0;
+  return strncmp(reply, "error", 5) != 0;
+}
+
+void *
+Client (void *arg)
+{
+  int n = (int) (long) arg, i, fd;
+  double *lat = latency + n*requests;
+  char buf[200], reply[8000], move[80];
+  struct sockaddr_un addr;
+  FILE *f;
+  memset(&addr, 0, sizeof(addr)); addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) || !(f = fdopen(fd, "r"))) {
+    perror(path); __sync_fetch_and_add(&failed, requests); return NULL;
+  }
+  snprintf(buf, sizeof(buf), "new %s\n", variant);
+  if(!Ask(fd, f, buf, reply, sizeof(reply))) { fprintf(stderr, "client %d: %s", n, reply); __sync_fetch_and_add(&failed, requests); return NULL; }
+  for(i=0; i<requests; i++) {
+    double t = Now();
+    if(!Ask(fd, f, goCmd, reply, sizeof(reply)) || sscanf(reply, "bestmove %79s", move) != 1) break;
+    lat[i] = Now() - t;
+    if(!strcmp(move, "none")) snprintf(buf, sizeof(buf), "new %s\n", variant); // game over; start new one
+    else snprintf(buf, sizeof(buf), "move %s\n", move);
+    if(!Ask(fd, f, buf, reply, sizeof(reply))) break;
+  }
+  if(i < requests) fprintf(stderr, "client %d: %s", n, reply), __sync_fetch_and_add(&failed, requests - i);
+  if(write(fd, "quit\n", 5) < 0) {}
+  fclose(f);
+  return NULL;
+}
+
+int
+Compare (const void *a, const void *b)
+{
+  double x = *(double *) a, y = *(double *) b;
+  return (x > y) - (x < y);
+}
+
+int
+main (int argc, char **argv)
+{
+  pthread_t *t;
+  int i, n = 0, depth = 0, nodes = 0, ms = 0;
+  double start, wall, sum = 0;
+  if(argc < 2) { fprintf(stderr, "usage: %s SOCKET [clients=N] [requests=N] [variant=NAME] [depth=N] [nodes=N] [ms=N]\n", argv[0]); return 1; }
+  path = argv[1];
+  for(i=2; i<argc; i++)
+    sscanf(argv[i], "clients=%d", &clients), sscanf(argv[i], "requests=%d", &requests), sscanf(argv[i], "variant=%79s", variant),
+    sscanf(argv[i], "depth=%d", &depth), sscanf(argv[i], "nodes=%d", &nodes), sscanf(argv[i], "ms=%d", &ms);
+  if(clients < 1 || requests < 1) return 1;
+  if(!depth && !nodes && !ms) depth = 4;
+  snprintf(goCmd, sizeof(goCmd), "go depth=%d nodes=%d ms=%d\n", depth, nodes, ms);
+  latency = malloc(clients*requests*sizeof(double)); t = malloc(clients*sizeof(pthread_t));
+  if(!latency || !t) return 1;
+  for(i=0; i<clients*requests; i++) latency[i] = -1; // not done
+  start = Now();
+  for(i=0; i<clients; i++) if(pthread_create(t + i, NULL, Client, (void *) (long) i)) { perror("thread"); return 1; }
+  for(i=0; i<clients; i++) pthread_join(t[i], NULL);
+  wall = Now() - start;
+  for(i=0; i<clients*requests; i++) if(latency[i] >= 0) sum += latency[n++] = latency[i];
+  qsort(latency, n, sizeof(double), Compare);
+  printf("%d clients, %d requests (%d failed) in %.3f s: %.1f requests/s\n", clients, n, failed, wall/1000, n ? n/(wall/1000) : 0.);
+  if(n) printf("latency ms: mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", sum/n,
+               latency[n/2], latency[n*9/10], latency[n*99/100], latency[n-1]);
+  return failed != 0;
+}
@@ -0,0 +1,286 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Monte-Carlo tree search, for variants so large that alpha-beta cannot get deep enough.
+// Every playout descends the tree by UCT, where a node only considers its best few children (in order of the
+// immediate gain of their move) until it has been visited more, expands the leaf it reaches with all legal moves,
+// optionally plays some random moves (captures preferred), and scores the final position by quiescence search.
+// The tree lives in an area of fixed size, which caps its memory use; when it is full, leaves are no longer expanded.
+// The playouts are done by several workers, which are forked processes sharing the tree area (the engine state
+// is global); a playout in progress counts as a loss for the nodes on its path (virtual loss), so that workers
+// spread over the tree. The library build and Windows have a single worker.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "eval.h"
+#include "hachu.h"
+#include "mcts.h"
+#include "move.h"
+#include "piece.h"
+#include "types.h"
+#include "variant.h"
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define MCTS_WIN    1000 /* result of a won playout */
+#define MCTS_C      0.7  /* exploration constant of UCT */
+#define MCTS_PLY    100  /* longest path through tree */
+
+typedef struct {
+  Move move;      // move leading to this node
+  int child;      // first of its children, which are consecutive (0 = not expanded, -1 = being expanded)
+  int nChild;
+  int visits;     // playouts through this node, including those still in progress
+  int wins;       // sum of results of finished playouts, for the side that played move
+} MctsNode;
+
+typedef struct {
+  volatile int stop;  // workers must finish
+  int playouts, size; // finished playouts, nodes in use
+  int maxPly;         // deepest expansion
+  MctsNode node[];    // node[0] is the root
+} MctsTree;
+
+typedef struct {
+  UndoInfo undo;      // what MakeMove2 overwrites, and UnMake2 needs to take back the move before
+  Move sup0;
+} MctsUndo;
+
+THREAD char mctsVariants[200];
+THREAD int mctsWorkers = 1, mctsMB = 64, mctsPlies;
+static THREAD MctsTree *tree;
+static THREAD int treeMB, maxNodes, lastPlayouts, lastTime, lastSize;
+static THREAD unsigned int rnd;
+
+int
+MctsWanted ()
+{ // name of current variant is on list of option
+  int n = strlen(variant->name);
+  char *s;
+  for(s=mctsVariants; (s = strstr(s, variant->name)); s += n)
+    if((s == mctsVariants || s[-1] == ',' || s[-1] == ' ') && (!s[n] || s[n] == ',' || s[n] == ' ')) return 1;
+  return 0;
+}
+
+static Color
+Descend (Color stm, Move move, MctsUndo *u)
+{ // make move in the tree (unlike MakeMove2, it can be taken back when other moves have been made after it)
+  u->undo = undoInfo; u->sup0 = sup0;
+  return MakeMove2(stm, move);
+}
+
+static void
+Ascend (MctsUndo *u)
+{
+  UnMake2(INVALID);
+  undoInfo = u->undo; sup0 = u->sup0;
+}
+
+static int
+Random (int n)
+{ // xorshift, seeded differently in every worker
+  rnd ^= rnd << 13; rnd ^= rnd >> 17; rnd ^= rnd << 5;
+  return rnd % n;
+}
+
+static int
+Select (MctsNode *v)
+{ // child to descend into: unvisited ones in order of gain, then by UCT; more children compete as visits grow
+  int i, best = 0, width = 2 + sqrt((double) v->visits), n = (v->nChild < width ? v->nChild : width);
+  double logN = log((double) v->visits + 1), bestVal = -1;
+  for(i=v->child; i<v->child+n; i++) {
+    MctsNode *c = tree->node + i;
+    double val;
+    if(!c->visits) return i;
+    val = c->wins / (double) (MCTS_WIN * c->visits) + MCTS_C * sqrt(logN / c->visits);
+    if(val > bestVal) bestVal = val, best = i;
+  }
+  return best;
+}
+
+static void
+Expand (MctsNode *v, Color stm, int msp, int ply)
+{ // give node its legal moves as children, most gaining first (so that they get visited first)
+  int i, j, n, first, last = ListMoves(stm, msp, 0), gain[2000];
+  MctsUndo u;
+  for(i=j=msp; i<last; i++) if(moveStack[i] != INVALID) moveStack[j++] = moveStack[i] & MOVEMASK;
+  n = j - msp;
+  do { // reserve n nodes only when they fit, so that a failed attempt leaves the size alone
+    first = tree->size;
+    if(n > 2000 || first + n > maxNodes) { v->child = 0; return; } // no room: remains leaf
+  } while(!__sync_bool_compare_and_swap(&tree->size, first, first + n));
+  for(i=0; i<n; i++) {
+    Move m = moveStack[msp+i];
+    int g;
+    Descend(stm, m, &u); g = undoInfo.booty; Ascend(&u);
+    for(j=i; j>0 && gain[j-1] < g; j--) gain[j] = gain[j-1], tree->node[first+j].move = tree->node[first+j-1].move;
+    gain[j] = g; tree->node[first+j].move = m;
+  }
+  for(i=first; i<first+n; i++) tree->node[i].child = tree->node[i].nChild = tree->node[i].visits = tree->node[i].wins = 0;
+  v->nChild = n;
+  __sync_synchronize(); // children must be complete before other workers can see them
+  v->child = first;
+  if(ply > tree->maxPly) tree->maxPly = ply;
+}
+
+static int
+Simulate (Color stm, int msp)
+{ // result for stm of a playout from current position: some random moves, and quiescence search of the final position
+  MctsUndo u[20];
+  int i, n, last, score;
+  double w;
+  for(n=0; n<mctsPlies; n++) {
+    int caps = 0, k;
+    last = ListMoves(stm, msp, 0);
+    for(i=k=msp; i<last; i++) if(moveStack[i] != INVALID) { // compact list, with captures in front
+      Move m = moveStack[i] & MOVEMASK;
+      moveStack[k++] = m;
+      if((m & SQUARE) < SPECIAL && board[m & SQUARE] != EMPTY) moveStack[k-1] = moveStack[msp+caps], moveStack[msp+caps++] = m;
+    }
+    if(k == msp) break; // game over
+    k = (caps && Random(4) ? Random(caps) : Random(k - msp)); // captures get three quarters of the choices
+    stm = Descend(stm, moveStack[msp+k], u + n);
+  }
+  score = Quiesce(stm, msp);
+  for(i=n; i>0; i--) Ascend(u + i - 1);
+  w = 1. / (1. + exp(-score / (3. * (pVal ? pVal : 50)))); // win probability of side that has the move now
+  if(n & 1) w = 1. - w;
+  return w * MCTS_WIN + 0.5;
+}
+
+static void
+Playout (Color stm, int msp)
+{
+  MctsUndo u[MCTS_PLY];
+  int path[MCTS_PLY], n = 0, i, x = 0, result;
+  __sync_fetch_and_add(&tree->node[0].visits, 1);
+  path[n++] = 0;
+  while(n < MCTS_PLY) { // SELECTION
+    MctsNode *v = tree->node + x;
+    int c = v->child;
+    if(!c) { // leaf: try to claim its expansion
+      if(__sync_bool_compare_and_swap(&v->child, 0, -1)) Expand(v, stm, msp, n);
+      break;
+    }
+    if(c < 0 || !v->nChild) break; // other worker expands it, or game over: evaluate it as it is
+    x = Select(v);
+    __sync_fetch_and_add(&tree->node[x].visits, 1); // virtual loss until the result comes in
+    stm = Descend(stm, tree->node[x].move, u + n);
+    path[n++] = x;
+  }
+  result = Simulate(stm, msp); // for side to move in leaf
+  for(i=n-1; i>=0; i--) {      // BACK-PROPAGATION
+    result = MCTS_WIN - result; // for side that played the move to this node
+    __sync_fetch_and_add(&tree->node[path[i]].wins, result);
+    if(i) Ascend(u + i);
+  }
+}
+
+static int
+BestChild (int x)
+{ // most visited child of node
+  MctsNode *v = tree->node + x;
+  int i, best = -1;
+  if(v->child <= 0) return -1;
+  for(i=v->child; i<v->child+v->nChild; i++) if(best < 0 || tree->node[i].visits > tree->node[best].visits) best = i;
+  return best;
+}
+
+static int
+Report (int final)
+{ // put most-visited line in pv[], print it as thinking output, and return score of its first move
+  int i, x = 0, score = 0, t = GetTickCount() - startTime;
+  for(i=0; i<MCTS_PLY-1 && (x = BestChild(x)) >= 0 && tree->node[x].visits; i++) pv[i] = tree->node[x].move;
+  pv[i] = 0;
+  if((x = BestChild(0)) >= 0 && tree->node[x].visits) {
+    double q = tree->node[x].wins / (double) (MCTS_WIN * tree->node[x].visits);
+    q = (q < 0.001 ? 0.001 : q > 0.999 ? 0.999 : q);
+    score = 3. * (pVal ? pVal : 50) * log(q / (1. - q));
+  }
+  if(postThinking > 0) {
+    printf("%d %d %d %d", tree->maxPly, score, t/10, tree->playouts);
+    for(i=0; pv[i]; i++) printf(" %s", MoveToText(pv[i], 0));
+    printf("\n");
+  }
+  if(final || postThinking > 0)
+    printf("# MCTS: %d playouts (%d/s), tree %d nodes (%d%% of %d MB), %d worker(s)\n", tree->playouts,
+           (int) (1000LL * tree->playouts / (t ? t : 1)), tree->size, (int) (100LL * tree->size / maxNodes), treeMB, mctsWorkers);
+  fflush(stdout);
+  return score;
+}
+
+int
+MctsSearch (Color stm, int msp)
+{
+  int i, workers = 1, post = postThinking, lastReport, score;
+  Move savedRep[LEVELS+1];
+  Flag savedCheck[LEVELS+1];
+#if !defined(WIN32) && !defined(LIBHACHU)
+  int pid[64];
+  workers = (mctsWorkers < 1 ? 1 : mctsWorkers > 64 ? 64 : mctsWorkers);
+#endif
+  if(!tree || treeMB != mctsMB) { // (re)allocate tree area, shared by workers
+#ifdef WIN32
+    free(tree); tree = malloc((size_t) mctsMB << 20);
+#else
+    if(tree) munmap(tree, (size_t) treeMB << 20);
+    tree = mmap(NULL, (size_t) mctsMB << 20, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(tree == MAP_FAILED) tree = NULL;
+#endif
+    if(!tree) { printf("# no memory for MCTS tree\n"); retMove = INVALID; *pv = 0; return 0; }
+    treeMB = mctsMB; maxNodes = (((size_t) treeMB << 20) - sizeof(MctsTree)) / sizeof(MctsNode);
+  }
+  memcpy(savedRep, repStack, sizeof(savedRep)); memcpy(savedCheck, checkStack, sizeof(savedCheck)); // UnMake2 loses oldest
+  tree->stop = tree->playouts = tree->maxPly = 0; tree->size = 1;
+  memset(tree->node, 0, sizeof(MctsNode));
+  postThinking = 0; // the quiescence searches must be silent
+  fflush(stdout);   // nothing buffered must be duplicated by fork
+  for(i=1; i<workers; i++) {
+#if !defined(WIN32) && !defined(LIBHACHU)
+    if(!(pid[i] = fork())) { // worker: do playouts until the first worker has seen enough
+      rnd = GetTickCount() * 2654435761U + i;
+      while(!tree->stop) Playout(stm, msp), __sync_fetch_and_add(&tree->playouts, 1);
+      _exit(0);
+    }
+#endif
+  }
+  rnd = GetTickCount() * 2654435761U;
+  lastReport = GetTickCount();
+  for(i=1; ; i++) { // first worker also watches clock and input
+    Playout(stm, msp); __sync_fetch_and_add(&tree->playouts, 1);
+    if(i & 15) continue;
+    abortFlag = TerminationCheck(stm); // hard time limit, node limit, or input while pondering
+    if(abortFlag > 0) break;
+    if(abortFlag >= 0 && (GetTickCount() - startTime) / 5 * 2 > tlim1) break; // as long as alpha-beta usually takes
+    if(maxDepth < MAXPLY && tree->playouts >= 1000 * maxDepth) break;        // 'sd' limits playouts
+    if(post > 0 && GetTickCount() - lastReport >= 1000) postThinking = post, Report(0), postThinking = 0, lastReport = GetTickCount();
+  }
+  tree->stop = 1;
+#if !defined(WIN32) && !defined(LIBHACHU)
+  for(i=1; i<workers; i++) if(pid[i] > 0) waitpid(pid[i], NULL, 0);
+#endif
+  memcpy(repStack, savedRep, sizeof(savedRep)); memcpy(checkStack, savedCheck, sizeof(savedCheck));
+  retMSP = ListMoves(stm, retFirst, 0); // playouts clobbered root list and its record of forbidden repetitions
+  postThinking = post;
+  score = Report(1);
+  retMove = pv[0]; rootDepth = tree->maxPly; lastRootIter = GetTickCount() - startTime;
+  lastPlayouts = tree->playouts; lastTime = lastRootIter; lastSize = tree->size;
+  return score;
+}
+
+void
+MctsStats ()
+{
+  if(lastPlayouts) printf("# MCTS: %d playouts in %d ms, tree %d nodes\n", lastPlayouts, lastTime, lastSize);
+}
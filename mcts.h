@@ -0,0 +1,21 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+#ifndef MCTS_H
+#define MCTS_H
+#include "types.h"
+
+// Monte-Carlo tree search, used instead of alpha-beta for the variants listed in the 'MCTS variants' option.
+
+extern THREAD char mctsVariants[200]; // names of the variants searched by MCTS, separated by commas
+extern THREAD int mctsWorkers;        // engine-defined option: processes doing playouts
+extern THREAD int mctsMB;             // engine-defined option: size of the tree (MB)
+extern THREAD int mctsPlies;          // engine-defined option: random moves in playout before its quiescence search
+
+int MctsWanted();                     // current variant is on the list
+int MctsSearch(Color stm, int msp);   // search current position; sets retMove and pv[] as Search does, and returns score
+void MctsStats();                     // playouts and tree size of last search ('stats' command)
+#endif
@@ -14,14 +14,14 @@
 #include "types.h"
 #include "variant.h"
 
-Move sup0, sup1, sup2; // promo suppression squares
-int repCnt;
-char *reason;
+THREAD Move sup0, sup1, sup2; // promo suppression squares
+THREAD int repCnt;
+THREAD char *reason;
 
 MoveInfo
 MoveToInfo (Move move)
 {
-  MoveInfo info = { .from = FROM(move), .to = move & SQUARE, .path = { EDGE, EDGE } };
+  MoveInfo info = { .from = FROM(move), .to = move & SQUARE, .path = { ABSENT, ABSENT } };
   if(info.to >= SPECIAL) {
     int i = info.to - SPECIAL;
     if(info.to < CASTLE) {
@@ -39,7 +39,7 @@ MoveToInfo (Move move)
 char *
 MoveToText (Move move, int multiLine) // copied from WB driver
 {
-  static char buf[50];
+  static THREAD char buf[50];
   int from = FROM(move), to = move & SQUARE;
   char *promoChar = "";
   if(from == to) { sprintf(buf, "@@@@"); return buf; } // null-move notation in WB protocol
@@ -148,12 +148,12 @@ printf("# deferral of %d\n", deferred);
     if(i >= listEnd) {
       for(i=listStart; i<listEnd; i++) printf("# %d. %08x %08x %s\n", i-50, moveStack[i], ret, MoveToText(moveStack[i], 0));
       reason = NULL;
-      for(i=0; i<repCnt; i++) {if((repeatMove[i] & REP_MASK) == ret) {
-        if(repeatMove[i] & 1<<24) reason = (repeatMove[i] & 1<<25 ? "Distant capture of protected Lion" : "Counterstrike against Lion");
+      for(j=0; j<repCnt; j++) {if((repeatMove[j] & REP_MASK) == ret) {
+        if(repeatMove[j] & 1<<24) reason = (repeatMove[j] & 1<<25 ? "Distant capture of protected Lion" : "Counterstrike against Lion");
         else reason = "Repeats earlier position";
         break;
       }
- printf("# %d. %08x %08x %s\n", i, repeatMove[i], ret, MoveToText(repeatMove[i], 0));
+ printf("# %d. %08x %08x %s\n", j, repeatMove[j], ret, MoveToText(repeatMove[j], 0));
 }
     }
   }
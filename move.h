@@ -10,9 +10,9 @@
 
 #define REP_MASK 0xFFFFFF
 
-extern Move sup0, sup1, sup2; // promo suppression squares
-extern int repCnt;
-extern char *reason;
+extern THREAD Move sup0, sup1, sup2; // promo suppression squares
+extern THREAD int repCnt;
+extern THREAD char *reason;
 
 MoveInfo MoveToInfo(Move move);     // unboxes (from, to, path)
 char *MoveToText(Move move, int m); // converts the move from your internal format to text like e2e2, e1g1, a7a8q.
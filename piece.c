@@ -35,9 +35,9 @@ Vector direction[2*RAYS] = { // clockwise!
   { 2,-1}
 };
 
-int epList[104], ep2List[104], toList[104], reverse[104];  // decoding tables for double and triple moves
-int kingStep[RAYS+2], knightStep[RAYS+2]; // raw tables for step vectors (indexed as -1 .. 8)
-int neighbors[RAYS+1];                    // similar to kingStep, but starts with null-step
+THREAD int epList[104], ep2List[104], toList[104], reverse[104];  // decoding tables for double and triple moves
+THREAD int kingStep[RAYS+2], knightStep[RAYS+2]; // raw tables for step vectors (indexed as -1 .. 8)
+THREAD int neighbors[RAYS+1];                    // similar to kingStep, but starts with null-step
 
 int attackMask[RAYS] = { // indicate which bits in attack-map item are used to count attacks from which direction
   000000007,
@@ -73,16 +73,17 @@ int ray[RAYS+1] = { // 1 in the bit fields for the various directions
  0100000000  // marks knight jumps
 };
 
-int pieces[COLORS], royal[COLORS];
+THREAD int pieces[COLORS], royal[COLORS];
 #if KYLIN
-int kylin[COLORS];
+THREAD int kylin[COLORS];
 #endif
-PieceInfo p[NPIECES]; // piece list
-int pVal;             // value of pawn per variant
+THREAD PieceInfo p[NPIECES]; // piece list
+THREAD int pVal;             // value of pawn per variant
 
-int squareKey[BSIZE];
+THREAD int squareKey[BSIZE];
+THREAD PieceDesc *pieceDesc[NPIECES]; // descriptor each piece-list entry was made from
 
-Flag promoBoard[BSIZE] = { [0 ... BSIZE-1] = 0 }; // flags to indicate promotion zones
+THREAD Flag promoBoard[BSIZE] = { [0 ... BSIZE-1] = 0 }; // flags to indicate promotion zones
 
 PieceDesc *
 ListLookUp (char *name, PieceDesc *list)
@@ -127,23 +128,6 @@ LookUp (char *name, int var)
   return NULL;
 }
 
-void
-DeletePiece (Color c, int n)
-{ // remove piece number n from the mentioned side's piece list (and adapt the reference to the displaced pieces!)
-  int i;
-  for(i=c+2; i<=pieces[c]; i+=2)
-    if(p[i].promo > n) p[i].promo -= 2;
-  for(i=n; i<pieces[c]; i+=2) {
-    p[i] = p[i+2];
-    if(i+2 == royal[c]) royal[c] -= 2; // NB: squeezing out the King moves up Crown Prince to royal[c]
-#if KYLIN
-    if(i+2 == kylin[c]) kylin[c] -= 2;
-#endif
-    if(i < 10) fireFlags[i-2] = fireFlags[i];
-  }
-  pieces[c] -= 2;
-}
-
 int
 Worse (int a, int b)
 { // determine if range a not upward compatible with b
@@ -209,60 +193,36 @@ Range (MoveType *range)
   return m;
 }
 
-void
-Compactify (Color c)
-{ // remove pieces that are permanently gone (captured or promoted) from one side's piece list
-  int i, k;
-  for(i=c+2; i<=pieces[c]; i+=2) { // first pass: unpromoted pieces
-    if((k = p[i].promo) >= 0 && p[i].pos == ABSENT) { // unpromoted piece no longer there
-      p[k].promo = -2; // orphan promoted version
-      DeletePiece(c, i);
-    }
-  }
-  for(i=c+2; i<=pieces[c]; i+=2) { // second pass: promoted pieces
-    if((k = p[i].promo) == -2 && p[i].pos == ABSENT) { // orphaned promoted piece not present
-      DeletePiece(c, i);
-    }
-  }
-  StackMultis(c);
+int *
+PieceKey (Color c, PieceDesc *list)
+{ // Zobrist key of the piece type, created on first use
+  int *key = (c == WHITE ? &list->whiteKey : &list->blackKey);
+  if(!*key) *key = ~(myRandom()*myRandom());
+  return key;
 }
 
-int
-AddPiece (Color c, PieceDesc *list)
-{
-  int i, j, *key, v;
-  for(i=c+2; i<=pieces[c]; i += 2) {
-    if(p[i].value < list->value || p[i].value == list->value && (p[i].promo < 0)) break;
-  }
-  pieces[c] += 2;
-  for(j=pieces[c]; j>i; j-= 2) p[j] = p[j-2];
+void
+FillPiece (Color c, int i, PieceDesc *list)
+{ // initialize piece-list entry i from its descriptor
+  int j, v;
   p[i].value = v = list->value;
+  pieceDesc[i] = list;
   for(j=0; j<RAYS; j++) p[i].range[j] = list->range[j^(RAYS/2)*(WHITE-c)];
   switch(Range(p[i].range)) {
     case 1:  p[i].pst = PST_STEPPER; break;
     case 2:  p[i].pst = PST_JUMPER; break;
     default: p[i].pst = PST_SLIDER;  break;
   }
-  key = (c == WHITE ? &list->whiteKey : &list->blackKey);
-  if(!*key) *key = ~(myRandom()*myRandom());
   p[i].promoGain = EasyProm(list->range); // flag easy promotion based on white view
-  p[i].pieceKey = *key;
+  p[i].pieceKey = *PieceKey(c, list);
   p[i].promoFlag = 0;
   p[i].bulk = list->bulk;
   p[i].ranking = list->ranking;
   p[i].mobWeight = v > 600 ? 0 : v >= 400 ? 1 : v >= 300 ? 2 : v > 150 ? 3 : v >= 100 ? 2 : 0;
   if(Lance(list->range))
     p[i].mobWeight = 0, p[i].pst = list->range[4] ? PST_NEUTRAL : PST_LANCE; // keep back
-  for(j=c+2; j<= pieces[c]; j+=2) {
-    if(p[j].promo >= i) p[j].promo += 2;
-  }
-  if(royal[c] >= i) royal[c] += 2;
-#if KYLIN
-  if(kylin[c] >= i) kylin[c] += 2;
-#endif
-  if(p[i].value == (currentVariant == V_SHO || currentVariant == V_WA ? 410 : 280) ) royal[c] = i, p[i].pst = PST_NEUTRAL;
+  if(v == ROYALVAL) royal[c] = i, p[i].pst = PST_NEUTRAL;
   p[i].qval = (tenFlag ? list->ranking : 0); // jump-capture hierarchy
-  return i;
 }
 
 int myRandom()
@@ -276,8 +236,8 @@ Init (int var)
   int i, j, k;
   PieceDesc *pawn;
 
-  variant = &(variants[var]);
   if(var != SAME) { // the following should be already set if we stay in same variant (for TakeBack)
+  variant = &(variants[var]);
   currentVariant = variants[var].varNr;
   bFiles = variants[var].boardFiles;
   bRanks = variants[var].boardRanks;
@@ -314,7 +274,11 @@ Init (int var)
   toList[100+3] = UL + 2; epList[100+1] = UL; ep2List[100+1] = UL + 3;
 
   // hash key tables
+#ifdef LIBHACHU
+  memcpy(squareKey, sharedSquareKey, sizeof(squareKey)); // same in all threads, so hash tables can move between them
+#else
   for(i=0; i<BSIZE; i++) squareKey[i] = ~(myRandom()*myRandom());
+#endif
 
   // promotion zones
   for(i=0; i<bRanks; i++) for(j=0; j<bFiles; j++) {
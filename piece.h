@@ -21,27 +21,27 @@
 #define DEMON(n) (p[n].value == FVAL)
 #define LION(n)  (p[n].value == LVAL)
 #define PAWN(n)  (p[n].value == pVal)
+#define ROYALVAL (currentVariant == V_SHO || currentVariant == V_WA ? 410 : 280) /* King value */
 
 PieceDesc *ListLookUp(char *name, PieceDesc *list);
 PieceDesc *LookUp(char *name, int var);
-void DeletePiece(Color c, int n);
 int Worse(int a, int b);
 int Lance(MoveType *r);
 int EasyProm(MoveType *r);
 Flag IsUpwardCompatible(MoveType *r, MoveType *s);
 int ForwardOnly(MoveType *range);
 int Range(MoveType *range);
-void Compactify(Color c);
-int AddPiece(Color c, PieceDesc *list);
+int *PieceKey(Color c, PieceDesc *list);
+void FillPiece(Color c, int i, PieceDesc *list);
 int myRandom();
 void Init(int var);
 void pplist();
 
 extern Vector direction[2*RAYS];
 
-extern int epList[104], ep2List[104], toList[104], reverse[104];  // decoding tables for double and triple moves
-extern int kingStep[RAYS+2], knightStep[RAYS+2]; // raw tables for step vectors (indexed as -1 .. 8)
-extern int neighbors[RAYS+1];                    // similar to kingStep, but starts with null-step
+extern THREAD int epList[104], ep2List[104], toList[104], reverse[104];  // decoding tables for double and triple moves
+extern THREAD int kingStep[RAYS+2], knightStep[RAYS+2]; // raw tables for step vectors (indexed as -1 .. 8)
+extern THREAD int neighbors[RAYS+1];                    // similar to kingStep, but starts with null-step
 #define kStep (kingStep+1)
 #define nStep (knightStep+1)
 
@@ -68,17 +68,21 @@ extern int ray[RAYS+1];
 //   (1) can promote (2) can defer when the to-square is on last rank, last two ranks, or anywhere.
 //   Pawns normally can't defer anywhere, but if the user defers with them, their promoFlag is set to promote on last rank only
 
-extern int pieces[COLORS], royal[COLORS];
+extern THREAD int pieces[COLORS], royal[COLORS];
 #if KYLIN
-extern int kylin[COLORS];
+extern THREAD int kylin[COLORS];
 #endif
-extern PieceInfo p[NPIECES]; // piece list
-extern int pVal;             // value of pawn per variant
+extern THREAD PieceInfo p[NPIECES]; // piece list
+extern THREAD int pVal;             // value of pawn per variant
 
-extern int squareKey[BSIZE];
+extern THREAD int squareKey[BSIZE];
+extern THREAD PieceDesc *pieceDesc[NPIECES];
+#ifdef LIBHACHU
+extern int sharedSquareKey[BSIZE];  // created once by the library, copied by every thread
+#endif
 
-extern Flag promoBoard[BSIZE]; // promotion zone indicators
+extern THREAD Flag promoBoard[BSIZE]; // promotion zone indicators
 
-// Maximum of (ranks, files) of ray between squares
-#define dist(s1, s2) MAX(abs((s1-s2)/BW), abs((s1-s2)%BW))
+// Maximum of (ranks, files) of ray between squares (separate coordinates, as the raw difference wraps on anti-diagonals)
+#define dist(s1, s2) MAX(abs((s1)/BW - (s2)/BW), abs((s1)%BW - (s2)%BW))
 #endif
@@ -0,0 +1,124 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Probing of the endgame tables made by tbgen (format in tb.h). Tables are memory-mapped on first use.
+
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "piece.h"
+#include "tb.h"
+#include "types.h"
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TBCACHE 64 /* material combinations remembered (also when there is no table for them) */
+
+typedef struct {
+  int var;                 // variant it is for
+  char material[2*TBMEN+1];
+  unsigned char *data;     // NULL = no table
+  TBHeader *h;
+  long size;
+} TBTable;
+
+THREAD char tbPath[200];
+THREAD int tbHits;
+static THREAD TBTable tables[TBCACHE];
+static THREAD int nrTables;
+
+void
+TBPath (char *dir)
+{ // set directory with tables, and forget the tables from the old one
+  int i;
+#ifndef WIN32
+  for(i=0; i<nrTables; i++) if(tables[i].data) munmap(tables[i].h, tables[i].size);
+#endif
+  for(i=0; i<nrTables; i++) tables[i].data = NULL;
+  nrTables = 0;
+  for(i=strlen(dir); i>0 && (dir[i-1] == ' ' || dir[i-1] == '\r'); i--) {} // trailing white space
+  snprintf(tbPath, sizeof(tbPath), "%.*s", i, dir);
+}
+
+static TBTable *
+Find (char *material)
+{ // table for material in current variant, mapped on first request
+  TBTable *t;
+  int i;
+  for(i=0; i<nrTables; i++) if(tables[i].var == currentVariant && !strcmp(tables[i].material, material)) return tables + i;
+  t = tables + (nrTables < TBCACHE ? nrTables++ : TBCACHE-1); // when full, keep recycling the last slot
+#ifndef WIN32
+  if(t->data) munmap(t->h, t->size);
+#endif
+  t->var = currentVariant; strcpy(t->material, material); t->data = NULL;
+#ifndef WIN32
+  {
+    char name[300];
+    struct stat st;
+    int fd;
+    snprintf(name, sizeof(name), "%s/%s-%s.htb", tbPath, variant->name, material);
+    if((fd = open(name, O_RDONLY)) < 0) return t;
+    if(!fstat(fd, &st) && st.st_size > sizeof(TBHeader) &&
+       (t->h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+      TBHeader *h = t->h;
+      t->size = st.st_size;
+      if(h->magic == TB_MAGIC && !strcmp(h->variant, variant->name) && !strcmp(h->material, material) && h->men <= TBMEN &&
+         st.st_size == sizeof(TBHeader) + TBSize(h->men, h->mirror)) t->data = (unsigned char *) (h + 1);
+      else munmap(t->h, t->size), printf("# %s: not a valid table\n", name);
+    }
+    close(fd);
+  }
+#endif
+  return t;
+}
+
+static int
+Material (char *m, PieceDesc *d[COLORS][TBMEN], int *n, Color first)
+{ // name of material combination, with the men of the given color first; returns its length
+  Color c = first;
+  int i, len = 0;
+  do {
+    len += sprintf(m + len, "K");
+    for(i=1; i<n[c]; i++) len += sprintf(m + len, "%.3s", d[c][i]->name);
+  } while((c = INVERT(c)) != first);
+  return len;
+}
+
+int
+TBProbe (Color stm)
+{ // table entry for current position, TB_NONE if there is no table for its material
+  PieceDesc *d[COLORS][TBMEN], *x;
+  int sq[COLORS][TBMEN], n[COLORS], s[TBMEN], c, i, j, k, flip = 0;
+  char material[40];
+  TBTable *t;
+  for(c=BLACK; c<=WHITE; c++) { // collect men of each color in table order: King first, others as in piece list
+    n[c] = 1; sq[c][0] = -1;
+    for(i=c+2; i<=pieces[c]; i+=2) if((k = p[i].pos) != ABSENT) {
+      k = (RANK(k) - 1)*8 + FILECH(k) - 'a';
+      if(i == royal[c]) { sq[c][0] = k; continue; }
+      if(n[c] == TBMEN-1) return TB_NONE;
+      for(j=n[c]++, x=pieceDesc[i]; j>1 && d[c][j-1] > x; j--) d[c][j] = d[c][j-1], sq[c][j] = sq[c][j-1];
+      d[c][j] = x; sq[c][j] = k;
+    }
+    if(sq[c][0] < 0) return TB_NONE;
+  }
+  if(n[WHITE] + n[BLACK] > TBMEN || Material(material, d, n, WHITE) > 2*TBMEN) return TB_NONE;
+  t = Find(material);
+  if(!t->data) { // try with colors reversed (and board rotated)
+    Material(material, d, n, BLACK);
+    t = Find(material); flip = 63;
+    if(!t->data) return TB_NONE;
+  }
+  c = (flip ? BLACK : WHITE);
+  for(i=k=0; i<n[c]; i++) s[k++] = sq[c][i] ^ flip;
+  for(i=0, c=INVERT(c); i<n[c]; i++) s[k++] = sq[c][i] ^ flip;
+  tbHits++;
+  return t->data[TBIndex(k, t->h->mirror, flip ? INVERT(stm) : stm, s)];
+}
@@ -0,0 +1,66 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+#ifndef TB_H
+#define TB_H
+#include "types.h"
+
+// Endgame tables for the 8x8 variants, made by tbgen, and probed during search through a memory mapping.
+//
+// A table is for one material combination, named like KRKN: the white men, then the black men, each group
+// starting with the King and the others in the order of the variant's piece list. It holds one byte per position:
+//   0       draw
+//   1..253  distance to mate in plies + 1 (odd: side to move loses, even: it wins)
+//   255     illegal (men on same square, or side not to move in check)
+// The position index is side to move, followed by the squares (a1 = 0, b1 = 1, ..., h8 = 63) of the men in table order.
+// When all men move left-right symmetrically, the white King is mirrored to the a-d files, halving the size.
+// The file (VARIANT-MATERIAL.htb) is a TBHeader followed by the data.
+
+#define TB_MAGIC   0x42544848 /* "HHTB" */
+#define TBMEN      4          /* largest number of men in a table */
+#define TB_DRAW    0
+#define TB_ILLEGAL 255
+#define TB_NONE    (-1)       /* returned when there is no table */
+
+typedef struct {
+  int magic;
+  char variant[16];
+  char material[2*TBMEN+1];
+  unsigned char men, mirror, maxCode;
+} TBHeader;
+
+static inline long
+TBSize (int men, int mirror)
+{
+  return 2L * (mirror ? 32 : 64) << 6*(men - 1);
+}
+
+static inline long
+TBIndex (int men, int mirror, Color stm, int *sq)
+{ // index of position; when mirrored the squares of the men are flipped so that the white King gets on the a-d files
+  int i, flip = (mirror && (sq[0] & 4) ? 7 : 0);
+  long x = (mirror ? 32*stm + (sq[0] >> 3)*4 + (sq[0] & 3 ^ flip & 3) : 64*stm + sq[0]);
+  for(i=1; i<men; i++) x = x*64 + (sq[i] ^ flip);
+  return x;
+}
+
+static inline Color
+TBDecode (int men, int mirror, long x, int *sq)
+{ // inverse of TBIndex: squares of the men, and side to move
+  int i;
+  for(i=men-1; i>0; i--) sq[i] = x & 63, x >>= 6;
+  if(mirror) sq[0] = (x & 31) >> 2 << 3 | x & 3, x >>= 5;
+  else sq[0] = x & 63, x >>= 6;
+  return x;
+}
+
+#ifndef TBGEN
+int TBProbe(Color stm);     // table entry of position during search, or TB_NONE
+void TBPath(char *dir);     // directory with the tables ("" = none)
+extern THREAD char tbPath[];
+extern THREAD int tbHits;
+#endif
+#endif
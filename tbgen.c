@@ -0,0 +1,440 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Retrograde generator of the endgame tables for the 8x8 variants (format in tb.h), from the piece lists of variant.c.
+// Usage: tbgen VARIANT MATERIAL... [dir=DIR] [threads=N] [verify=1]
+// MATERIAL is like KRKN (white men, then black men). The tables its captures lead to are made first when they
+// are not in DIR yet. Pieces can have steps, slides, Knight jumps, plain jumps and Lion moves; tables with Pawns,
+// Werewolves, or Lions on both sides (where the Lion-trade rules would matter) are refused.
+
+#define TBGEN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "tb.h"
+#include "types.h"
+#include "variant.h"
+
+#define CAP_DRAW 254 /* in cap[]: best capture draws */
+#define WIN(c)  ((c) && (c) < CAP_DRAW && !((c) & 1))
+
+typedef unsigned long long Bitboard;
+
+typedef struct {
+  int dr, df, count; // up to count steps of (dr, df)
+} Leap;
+
+typedef struct Table {
+  char material[2*TBMEN+1];
+  int men, bk, mirror, maxCode; // bk = index of black King
+  long size;
+  PieceDesc *desc[TBMEN];
+  Color color[TBMEN];
+  int nLeaps[TBMEN], lion[TBMEN];   // lion: directions with Lion power
+  int done;                         // val[] is complete
+  Leap leap[TBMEN][3*RAYS];
+  Bitboard jumps[TBMEN][64], slides[TBMEN][64]; // squares attacked from each square; slides can be blocked
+  struct Table *sub[TBMEN];         // table after capture of man (NULL: only Kings left)
+  unsigned char *val, *cnt, *cap;   // value, number of non-captures not known to lose, best capture
+  struct Table *next;
+} Table;
+
+int var = -1, stalemate, nThreads = 1, verify;
+char *dir = ".";
+PieceDesc *list;
+Table *tables;
+Bitboard between[64][64];
+int kdir[RAYS][2] = { {1,0}, {1,1}, {0,1}, {-1,1}, {-1,0}, {-1,-1}, {0,-1}, {1,-1} }; // as direction[] in piece.c
+int ndir[RAYS][2] = { {2,1}, {1,2}, {-1,2}, {-2,1}, {-2,-1}, {-1,-2}, {1,-2}, {2,-1} };
+
+Table *Make(char *material);
+
+int
+Square (int x, int dr, int df)
+{ // square reached from x by (dr, df), or -1 when off board
+  int r = (x >> 3) + dr, f = (x & 7) + df;
+  return r < 0 || r > 7 || f < 0 || f > 7 ? -1 : 8*r + f;
+}
+
+void
+InitBetween ()
+{
+  int x, j, k, y;
+  for(x=0; x<64; x++) for(j=0; j<RAYS; j++) {
+    Bitboard b = 0;
+    for(k=1; (y = Square(x, k*kdir[j][0], k*kdir[j][1])) >= 0; k++) between[x][y] = b, b |= 1ULL << y;
+  }
+}
+
+void
+AddLeap (Table *t, int m, int dr, int df, int count)
+{
+  Leap *l = &t->leap[m][t->nLeaps[m]++];
+  l->dr = dr; l->df = df; l->count = count;
+}
+
+int
+Leaps (Table *t, int m)
+{ // moves of man m from its ranges (rotated for black, as in FillPiece), and the squares it attacks; 0 if not supported
+  PieceDesc *d = t->desc[m];
+  int i, j, k, x, y;
+  for(j=0; j<RAYS; j++) {
+    int r = d->range[j^(RAYS/2)*(WHITE-t->color[m])];
+    if(r > 0 && r <= X) AddLeap(t, m, kdir[j][0], kdir[j][1], MIN(r, 7));
+    else if(r == N) AddLeap(t, m, ndir[j][0], ndir[j][1], 1);
+    else if(r == J) AddLeap(t, m, 2*kdir[j][0], 2*kdir[j][1], 1);
+    else if(r == L) { // Lion: all squares within distance 2, plus the hit-and-run captures (done in Moves)
+      AddLeap(t, m, kdir[j][0], kdir[j][1], 1);
+      AddLeap(t, m, 2*kdir[j][0], 2*kdir[j][1], 1);
+      AddLeap(t, m, ndir[j][0], ndir[j][1], 1);
+      t->lion[m] |= 1 << j;
+    } else if(r) return 0;
+  }
+  for(x=0; x<64; x++) for(i=0; i<t->nLeaps[m]; i++) {
+    Leap *l = &t->leap[m][i];
+    int jump = abs(l->dr) > 1 || abs(l->df) > 1;
+    for(k=1; k<=l->count && (y = Square(x, k*l->dr, k*l->df)) >= 0; k++)
+      if(jump) t->jumps[m][x] |= 1ULL << y; else t->slides[m][x] |= 1ULL << y;
+  }
+  return 1;
+}
+
+Bitboard
+Mirror (Bitboard b)
+{ // flip files
+  Bitboard r = 0;
+  int x;
+  for(x=0; x<64; x++) if(b >> x & 1) r |= 1ULL << (x ^ 7);
+  return r;
+}
+
+static inline int
+Attacked (Table *t, int *sq, Color c, int target, Bitboard occ)
+{ // is target attacked by a man of color c (captured men have square -1)?
+  int m, x;
+  for(m=0; m<t->men; m++) if(t->color[m] == c && (x = sq[m]) >= 0) {
+    if(t->jumps[m][x] >> target & 1) return 1;
+    if(t->slides[m][x] >> target & 1 && !(between[x][target] & occ)) return 1;
+  }
+  return 0;
+}
+
+static inline int
+Rank (int code)
+{ // preference of move result, for the side making it
+  return code == 0 ? -2000 : WIN(code) ? 1000 - code : code == CAP_DRAW ? 0 : -1000 + code;
+}
+
+static inline int
+Child (Table *t, int *sq, int victim, Color stm, Bitboard occ)
+{ // result of move to position sq (victim = captured man or -1) for side that made it; -1 if illegal, 0 if non-capture in init pass
+  int s[TBMEN], i, n = 0, code;
+  Table *u = t;
+  if(Attacked(t, sq, INVERT(stm), sq[stm == WHITE ? 0 : t->bk], occ)) return -1; // moved into check
+  if(victim < 0) { if(!t->done) return 0; }
+  else if(!(u = t->sub[victim])) return CAP_DRAW; // bare Kings
+  for(i=0; i<t->men; i++) if(i != victim) s[n++] = sq[i];
+  code = u->val[TBIndex(n, u->mirror, INVERT(stm), s)];
+  return code == TB_DRAW ? CAP_DRAW : code + 1;
+}
+
+int
+Moves (Table *t, int *sq, Color stm, int *best)
+{ // number of legal non-captures of position; best = best result of captures (and non-captures once table is done)
+  Bitboard occ = 0;
+  int m, w, i, k, x, y, e, code, n = 0, man[64];
+  *best = 0;
+  for(m=0; m<t->men; m++) occ |= 1ULL << sq[m], man[sq[m]] = m;
+  for(m=0; m<t->men; m++) if(t->color[m] == stm) {
+    x = sq[m];
+    for(i=0; i<t->nLeaps[m]; i++) {
+      Leap *l = &t->leap[m][i];
+      for(k=1; k<=l->count && (y = Square(x, k*l->dr, k*l->df)) >= 0; k++) {
+        if(occ >> y & 1) { // capture, if enemy
+          if(t->color[w = man[y]] != stm) {
+            sq[m] = y; sq[w] = -1;
+            code = Child(t, sq, w, stm, occ & ~(1ULL << x));
+            sq[m] = x; sq[w] = y;
+            if(code > 0 && Rank(code) > Rank(*best)) *best = code;
+          }
+          break;
+        }
+        sq[m] = y;
+        code = Child(t, sq, -1, stm, occ ^ 1ULL << x ^ 1ULL << y);
+        sq[m] = x;
+        if(code >= 0) n++;
+        if(code > 0 && Rank(code) > Rank(*best)) *best = code;
+      }
+    }
+    if(t->lion[m]) { // hit-and-run captures of adjacent men (including igui), and pass
+      int pass = 0;
+      for(i=0; i<RAYS; i++) if((y = Square(x, kdir[i][0], kdir[i][1])) >= 0) {
+        if(!(occ >> y & 1)) { pass = 1; continue; }
+        if(!(t->lion[m] >> i & 1) || t->color[w = man[y]] == stm) continue;
+        for(k=0; k<RAYS; k++) if((e = Square(y, kdir[k][0], kdir[k][1])) >= 0 && (e == x || !(occ >> e & 1))) {
+          sq[m] = e; sq[w] = -1;
+          code = Child(t, sq, w, stm, occ & ~(1ULL << x | 1ULL << y) | 1ULL << e);
+          sq[m] = x; sq[w] = y;
+          if(code > 0 && Rank(code) > Rank(*best)) *best = code;
+        }
+      }
+      if(pass && !Attacked(t, sq, INVERT(stm), sq[stm == WHITE ? 0 : t->bk], occ)) { // (not when in check)
+        n++;
+        if(t->done) {
+          code = t->val[TBIndex(t->men, t->mirror, INVERT(stm), sq)];
+          code = (code == TB_DRAW ? CAP_DRAW : code + 1);
+          if(Rank(code) > Rank(*best)) *best = code;
+        }
+      }
+    }
+  }
+  return n;
+}
+
+typedef struct {
+  Table *t;
+  long from, to;
+  int level;
+  long count; // positions found at level
+} Job;
+
+void *
+Init (void *arg)
+{ // legality, number of non-captures and best capture of all positions in range; mates and positions with only captures
+  Job *j = arg;
+  Table *t = j->t;
+  long i;
+  int sq[TBMEN], m, best;
+  for(i=j->from; i<j->to; i++) {
+    Bitboard occ = 0;
+    Color stm = TBDecode(t->men, t->mirror, i, sq);
+    t->val[i] = t->cnt[i] = t->cap[i] = 0;
+    for(m=0; m<t->men; m++) if(occ >> sq[m] & 1) break; else occ |= 1ULL << sq[m];
+    if(m < t->men || Attacked(t, sq, stm, sq[stm == WHITE ? t->bk : 0], occ)) { t->val[i] = TB_ILLEGAL; continue; }
+    t->cnt[i] = Moves(t, sq, stm, &best);
+    t->cap[i] = best;
+    if(t->cnt[i]) continue;
+    if(best == 0) // no legal moves: checkmate, or stalemate (loss in Shatranj)
+      t->val[i] = (stalemate && !Attacked(t, sq, INVERT(stm), sq[stm == WHITE ? 0 : t->bk], occ) ? TB_DRAW : 1);
+    else if(best != CAP_DRAW) t->val[i] = best;
+  }
+  return NULL;
+}
+
+void *
+Pending (void *arg)
+{ // wins by capture become final at their level, if no faster win was found
+  Job *j = arg;
+  Table *t = j->t;
+  long i;
+  for(i=j->from; i<j->to; i++) if(t->val[i] == 0 && t->cap[i] == j->level) t->val[i] = j->level;
+  return NULL;
+}
+
+static inline void
+Unmove (Table *t, int *sq, int m, int f, Color c, int n)
+{ // position before man m of side c came from square f is resolved by the position at level n it leads to
+  int x = sq[m];
+  long r;
+  sq[m] = f; r = TBIndex(t->men, t->mirror, c, sq); sq[m] = x;
+  if(t->val[r]) return; // already known, or illegal
+  if(n & 1) __sync_bool_compare_and_swap(t->val + r, 0, n + 1); // move to lost position wins
+  else if(__sync_sub_and_fetch(t->cnt + r, 1) == 0) { // all non-captures lose
+    int cap = t->cap[r];
+    if(!WIN(cap) && cap != CAP_DRAW) t->val[r] = MAX(n + 1, cap); // (capture wins are Pending)
+  }
+}
+
+void *
+Propagate (void *arg)
+{ // for all positions at level: resolve the positions that lead to them by a non-capture
+  Job *j = arg;
+  Table *t = j->t;
+  long i;
+  int sq[TBMEN], m, k, l, x, y;
+  for(i=j->from; i<j->to; i++) if(t->val[i] == j->level) {
+    Bitboard occ = 0;
+    Color stm = TBDecode(t->men, t->mirror, i, sq), c = INVERT(stm); // c made the move leading here
+    j->count++;
+    for(m=0; m<t->men; m++) occ |= 1ULL << sq[m];
+    for(m=0; m<t->men; m++) if(t->color[m] == c) {
+      x = sq[m];
+      for(l=0; l<t->nLeaps[m]; l++) {
+        Leap *v = &t->leap[m][l];
+        for(k=1; k<=v->count && (y = Square(x, -k*v->dr, -k*v->df)) >= 0 && !(occ >> y & 1); k++) Unmove(t, sq, m, y, c, j->level);
+      }
+      if(t->lion[m]) for(k=0; k<RAYS; k++) // pass, possible when Lion has an empty neighbor
+        if((y = Square(x, kdir[k][0], kdir[k][1])) >= 0 && !(occ >> y & 1)) { Unmove(t, sq, m, x, c, j->level); break; }
+    }
+  }
+  return NULL;
+}
+
+void *
+Verify (void *arg)
+{ // every value must be the best over the moves of the position
+  Job *j = arg;
+  Table *t = j->t;
+  long i;
+  int sq[TBMEN], best, n;
+  for(i=j->from; i<j->to; i++) if(t->val[i] != TB_ILLEGAL) {
+    Color stm = TBDecode(t->men, t->mirror, i, sq);
+    n = Moves(t, sq, stm, &best);
+    if(!n && !best) continue; // mate or stalemate
+    if(best == CAP_DRAW) best = TB_DRAW;
+    if(best != t->val[i]) j->count++;
+  }
+  return NULL;
+}
+
+long
+Parallel (Table *t, void *(*task)(void *), int level)
+{ // run task on all positions, divided over the threads; returns total count of jobs
+  pthread_t id[64];
+  Job job[64];
+  long total = 0;
+  int i, n = MAX(1, MIN(nThreads, 64));
+  for(i=0; i<n; i++) {
+    job[i].t = t; job[i].level = level; job[i].count = 0;
+    job[i].from = t->size*i/n; job[i].to = t->size*(i+1)/n;
+    if(pthread_create(id + i, NULL, task, job + i)) task(job + i), id[i] = 0;
+  }
+  for(i=0; i<n; i++) { if(id[i]) pthread_join(id[i], NULL); total += job[i].count; }
+  return total;
+}
+
+PieceDesc *
+Piece (char **s)
+{ // piece of list whose name starts the text (longest match)
+  PieceDesc *d, *best = NULL;
+  for(d=list; d->name; d++) if(!strncmp(*s, d->name, strlen(d->name)) && (!best || strlen(d->name) > strlen(best->name))) best = d;
+  if(best) *s += strlen(best->name);
+  return best;
+}
+
+void
+Name (Table *t, int skip, char *buf)
+{ // material of table without man skip
+  int m;
+  *buf = 0;
+  for(m=0; m<t->men; m++) if(m != skip) strcat(buf, t->desc[m]->name);
+}
+
+Table *
+Load (char *material)
+{ // read table from file made earlier
+  char name[300];
+  TBHeader h;
+  Table *t;
+  FILE *f;
+  snprintf(name, sizeof(name), "%s/%s-%s.htb", dir, variants[var].name, material);
+  if(!(f = fopen(name, "rb"))) return NULL;
+  if(fread(&h, sizeof(h), 1, f) != 1 || h.magic != TB_MAGIC || strcmp(h.material, material) || strcmp(h.variant, variants[var].name)
+     || !(t = calloc(1, sizeof(Table))) || !(t->val = malloc(TBSize(h.men, h.mirror)))
+     || fread(t->val, 1, TBSize(h.men, h.mirror), f) != TBSize(h.men, h.mirror)) {
+    fprintf(stderr, "%s: not a valid table\n", name); exit(1);
+  }
+  fclose(f);
+  t->men = h.men; t->mirror = h.mirror; t->maxCode = h.maxCode; t->size = TBSize(h.men, h.mirror); t->done = 1;
+  strcpy(t->material, material);
+  return t;
+}
+
+Table *
+Make (char *material)
+{ // table for material, from memory, file or generated (with the tables it depends on)
+  Table *t, *u;
+  char *s = material, buf[2*TBMEN+1];
+  PieceDesc *d;
+  FILE *f;
+  long n, wins = 0;
+  int m, i, level, maxCap = 0, lions[COLORS] = { 0, 0 };
+
+  if(!(t = calloc(1, sizeof(Table)))) exit(1);
+  for(m=0; *s; m++) { // parse material
+    if(m == TBMEN || !(d = Piece(&s))) { fprintf(stderr, "%s: more than %d men, or unknown piece\n", material, TBMEN); exit(1); }
+    if(!m && strcmp(d->name, "K")) break;
+    if(m && !strcmp(d->name, "K")) { if(t->bk) break; t->bk = m; }
+    t->desc[m] = d; t->color[m] = (t->bk ? BLACK : WHITE);
+  }
+  if(*s || !t->bk || m < 3) { fprintf(stderr, "%s: should be white King and men, then black King and men\n", material); exit(1); }
+  t->men = m;
+  for(m=1; m<t->men; m++) if(m != t->bk) // sort men of each color in piece-list order, as the engine expects
+    for(i=m; i>1 && i != t->bk+1 && t->desc[i-1] > t->desc[i]; i--) d = t->desc[i], t->desc[i] = t->desc[i-1], t->desc[i-1] = d;
+  Name(t, -1, t->material);
+  for(u=tables; u && strcmp(u->material, t->material); u=u->next) {} // look for it in memory, and on disk
+  if(u || (u = Load(t->material)) && (u->next = tables, tables = u)) { free(t); return u; }
+
+  for(m=0; m<t->men; m++) {
+    if(!Leaps(t, m)) { fprintf(stderr, "%s: piece %s has moves tbgen does not support\n", t->material, t->desc[m]->name); exit(1); }
+    lions[t->color[m]] |= t->lion[m];
+  }
+  if(lions[WHITE] && lions[BLACK]) { fprintf(stderr, "%s: Lions on both sides\n", t->material); exit(1); }
+  t->mirror = 1;
+  for(m=0; m<t->men; m++) for(i=0; i<64; i++) // all men move left-right symmetrically?
+    if(Mirror(t->jumps[m][i]) != t->jumps[m][i^7] || Mirror(t->slides[m][i]) != t->slides[m][i^7]) t->mirror = 0;
+  for(m=0; m<t->men; m++) if(m && m != t->bk && t->men > 3) { // tables for after capture of a man
+    Name(t, m, buf);
+    t->sub[m] = Make(buf);
+  }
+  t->size = TBSize(t->men, t->mirror);
+  if(!(t->val = malloc(t->size)) || !(t->cnt = malloc(t->size)) || !(t->cap = malloc(t->size))) {
+    fprintf(stderr, "%s: not enough memory\n", t->material); exit(1);
+  }
+  printf("%s: %ld positions", t->material, t->size); fflush(stdout);
+
+  Parallel(t, Init, 0);
+  for(n=0; n<t->size; n++) if(t->cap[n] != CAP_DRAW && t->cap[n] > maxCap) maxCap = t->cap[n];
+  for(level=1; level<CAP_DRAW-1; level++) {
+    if(!(level & 1)) Parallel(t, Pending, level);
+    if(!Parallel(t, Propagate, level) && level > maxCap) break;
+  }
+  if(level >= CAP_DRAW-1) { fprintf(stderr, "%s: mate too long\n", t->material); exit(1); }
+  t->maxCode = level - 1; t->done = 1;
+  free(t->cnt); free(t->cap); t->cnt = t->cap = NULL;
+  for(n=t->size/2; n<t->size; n++) wins += WIN(t->val[n]);
+  if(t->maxCode) printf(", longest mate %d plies, %ld wins with white to move\n", t->maxCode - 1, wins);
+  else printf(", no mates\n");
+  if(verify && (n = Parallel(t, Verify, 0))) { fprintf(stderr, "%s: %ld positions inconsistent\n", t->material, n); exit(1); }
+
+  { // write it
+    char name[300];
+    TBHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TB_MAGIC; h.men = t->men; h.mirror = t->mirror; h.maxCode = t->maxCode;
+    snprintf(h.variant, sizeof(h.variant), "%s", variants[var].name); strcpy(h.material, t->material);
+    snprintf(name, sizeof(name), "%s/%s-%s.htb", dir, variants[var].name, t->material);
+    if(!(f = fopen(name, "wb")) || fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(t->val, 1, t->size, f) != t->size || fclose(f))
+      { perror(name); exit(1); }
+  }
+  t->next = tables; tables = t;
+  return t;
+}
+
+int
+main (int argc, char **argv)
+{
+  int i;
+  if(argc < 3) { fprintf(stderr, "usage: %s VARIANT MATERIAL... [dir=DIR] [threads=N] [verify=1]\n", argv[0]); return 1; }
+  for(i=0; variants[i].boardRanks; i++) if(!strcmp(variants[i].name, argv[1])) var = i;
+  if(var >= 0) switch(variants[var].varNr) {
+    case V_CHESS:    list = chessPieces;    break;
+    case V_SHATRANJ: list = shatranjPieces; break;
+    case V_MAKRUK:   list = makrukPieces;   break;
+    case V_LION:     list = lionPieces;     break;
+    case V_WOLF:     list = wolfPieces;     break;
+  }
+  if(!list) { fprintf(stderr, "%s: not an 8x8 variant\n", argv[1]); return 1; }
+  stalemate = (variants[var].varNr != V_SHATRANJ); // as in the engine: Shatranj stalemate loses
+  for(i=2; i<argc; i++) {
+    if(!strncmp(argv[i], "dir=", 4)) dir = argv[i] + 4;
+    sscanf(argv[i], "threads=%d", &nThreads); sscanf(argv[i], "verify=%d", &verify);
+  }
+  InitBetween();
+  for(i=2; i<argc; i++) if(!strchr(argv[i], '=')) Make(argv[i]);
+  return 0;
+}
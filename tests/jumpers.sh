@@ -0,0 +1,23 @@
+#!/bin/sh
+# Regression test for the jump-barrier table: searches must give the same iterations (score, nodes, PV)
+# as a build that steps along the rays to find what a range jumper cannot pass (compiled with -DNO_JUMP_TABLE).
+# usage: tests/jumpers.sh HACHU HACHU-WALK
+
+search () { # variant, depth, moves leading to the position
+  printf 'xboard\nprotover 2\nmemory 16\nnew\nvariant %s\nforce\n' "$1"
+  for move in $3; do printf 'usermove %s\n' "$move"; done
+  printf 'post\nsd %s\nlevel 0 60 0\ntime 600000\ngo\nquit\n' "$2"
+}
+
+for engine in "$1" "$2"; do # thinking output without the time column
+  { search chu 5 "" | "$engine"
+    search chu 5 "h4h5 e9e8 g4g5 f9f8 f3g4" | "$engine"
+    search tenjiku 4 "" | "$engine"
+    search tenjiku 4 "j3k2 i13i1 h2i1" | "$engine"  # Great General jump-captured across the board
+  } | awk '/^[0-9]/ { $3 = ""; print } /^move/' > "$engine.jmp"
+done
+if cmp -s "$1.jmp" "$2.jmp" && [ "$(grep -c '^move' "$1.jmp")" = 4 ]; then
+  echo "jump barriers: ok"; rm -f "$1.jmp" "$2.jmp"
+else
+  echo "jump barriers: search differs from stepping"; diff "$1.jmp" "$2.jmp"; exit 1
+fi
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Regression test for the repetition filter: a search must give the same iterations (score, nodes, PV)
+# as a build that scans the repetition stack for every move (compiled with -DNO_REP_FILTER).
+# usage: tests/repetition.sh HACHU HACHU-FULLREP
+
+search () { # shatranj position where the side to move can return to the position after the last capture
+  printf 'xboard\nprotover 2\nmemory 16\nnew\nvariant shatranj\nforce\nsetboard 4k1rr/p7/8/2r5/8/8/1R6/R3K3 w 0 1\n'
+  printf 'usermove a1a7\nusermove c5c6\nusermove b2b3\nusermove c6c5\npost\nsd 6\nlevel 0 60 0\ntime 600000\ngo\n'
+  sleep 5; printf 'quit\n'
+}
+
+for engine in "$1" "$2"; do # thinking output without the time column
+  search | "$engine" | awk '/^[0-9]/ { $3 = ""; print } /^move/' > "$engine.rep"
+done
+if cmp -s "$1.rep" "$2.rep" && grep -q '^move' "$1.rep"; then
+  echo "repetition filter: ok"; rm -f "$1.rep" "$2.rep"
+else
+  echo "repetition filter: search differs from full scan"; diff "$1.rep" "$2.rep"; exit 1
+fi
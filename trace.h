@@ -0,0 +1,29 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+#ifndef TRACE_H
+#define TRACE_H
+#include "types.h"
+
+#define TRACE_MAGIC 0x52544348 /* "HCTR" */
+
+// flags in trace record
+#define TR_NULL  1 /* null-move search      */
+#define TR_PVS   2 /* null-window PVS probe */
+#define TR_ROOT  4 /* root iteration result */
+
+typedef struct {
+  Move move;
+  short alpha, beta, score; // window and result, from perspective of side that made the move
+  char level, depth, phase, flags;
+} TraceRecord; // one per searched node, written when its search returns
+
+typedef struct {
+  int magic, count, files, ranks; // count records follow, oldest first
+  int toList[104];                // decoding table for Lion moves
+} TraceHeader;
+
+#endif
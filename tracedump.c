@@ -0,0 +1,70 @@
+/**************************************************************************/
+/*                               HaChu                                    */
+/* A WinBoard engine for Chu Shogi (and some related games) by H.G.Muller */
+/**************************************************************************/
+/* This source code is released in the public domain                      */
+/**************************************************************************/
+// Offline decoder for the search trace HaChu writes with the 'trace' command.
+// Usage: tracedump FILE [MAXLEVEL]. Prints the traced tree in search order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+int bFiles, bRanks; // used by FILECH and RANK
+TraceHeader h;
+TraceRecord *rec;
+int *child, *sibling, maxLevel = 1000;
+
+char *
+MoveText (TraceRecord *r)
+{
+  static char buf[40];
+  int from = FROM(r->move), to = r->move & SQUARE;
+  if(r->flags & TR_NULL) return "null";
+  if(!r->move) return "-";
+  if(to >= SPECIAL) to = from + h.toList[to - SPECIAL]; // Lion move or castling: give final destination
+  sprintf(buf, "%c%d%c%d%s%s", FILECH(from), RANK(from), FILECH(to), RANK(to),
+          (r->move & SQUARE) >= SPECIAL ? "*" : "", r->move & PROMOTE ? "+" : "");
+  return buf;
+}
+
+void
+PrintTree (int n, int indent)
+{
+  TraceRecord *r = rec + n;
+  int c;
+  printf("%*s%d. %-8s d=%-3d ph=%d [%d,%d] %d%s%s\n", 2*indent, "", r->level, MoveText(r), r->depth, r->phase,
+         r->alpha, r->beta, r->score, r->flags & TR_PVS ? " pvs" : "", r->flags & TR_ROOT ? " (iteration)" : "");
+  if(r->level >= maxLevel) return;
+  for(c = child[n]; c >= 0; c = sibling[c]) PrintTree(c, indent + 1);
+}
+
+int
+main (int argc, char **argv)
+{
+  FILE *f;
+  int i, sp = 0, *stack;
+  if(argc < 2) { fprintf(stderr, "usage: %s FILE [MAXLEVEL]\n", argv[0]); return 1; }
+  if(argc > 2) maxLevel = atoi(argv[2]);
+  if(!(f = fopen(argv[1], "rb")) || fread(&h, sizeof(h), 1, f) != 1 || h.magic != TRACE_MAGIC) {
+    fprintf(stderr, "%s: not a HaChu trace\n", argv[1]); return 1;
+  }
+  bFiles = h.files; bRanks = h.ranks;
+  rec = malloc(h.count * sizeof(TraceRecord));
+  child = malloc(3 * h.count * sizeof(int)); sibling = child + h.count; stack = sibling + h.count;
+  if(!rec || !child || fread(rec, sizeof(TraceRecord), h.count, f) != h.count) { fprintf(stderr, "read error\n"); return 1; }
+  fclose(f);
+
+  // records are in post-order: the daughters of a node are the deeper subtrees completed just before it
+  for(i=0; i<h.count; i++) {
+    child[i] = -1;
+    while(sp > 0 && rec[stack[sp-1]].level > rec[i].level) {
+      int c = stack[--sp];
+      sibling[c] = child[i]; child[i] = c; // popped last-to-first, so prepending restores search order
+    }
+    stack[sp++] = i;
+  }
+  for(i=0; i<sp; i++) PrintTree(stack[i], rec[stack[i]].level); // roots (or orphans from ring-buffer wrap)
+  return 0;
+}
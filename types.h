@@ -7,10 +7,32 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#ifdef LIBHACHU
+#include <setjmp.h>
+#define THREAD __thread     /* built as library: every thread is a separate engine (see libhachu.h) */
+#define printf hachu_printf /* and engine output goes to the log hook instead of stdout */
+#define FATAL() longjmp(fatalJump, 1) /* abort API call, rather than the process */
+int hachu_printf(const char *fmt, ...);
+extern THREAD jmp_buf fatalJump;
+#else
+#include <setjmp.h>
+#define THREAD
+#define FATAL() (fatalCatch ? longjmp(fatalJump, 1) : exit(-1)) /* batch workers catch it, to report the position */
+extern jmp_buf fatalJump;
+extern int fatalCatch;
+#endif
+
+//#define STATS /* hot-path counters and timers, printed by 'stats' command (or compile with -DSTATS) */
+#ifdef STATS
+#define STAT(x) x           /* counting statement, only compiled with STATS */
+#else
+#define STAT(x)
+#endif
+
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
-#define BH 16
-#define BW 16
+#define BH 20 /* 16x16 Tenjiku with 2 guard ranks/files on each side, 13x13 with 3 (for Lion-Dog jumps) */
+#define BW 20
 #define BSIZE BW*BH
 #define STEP(X,Y) (BW*(X)+(Y))
 #define POS(X,Y) STEP((BH-bRanks)/2 + X, (BW-bFiles)/2 + Y)
@@ -27,14 +49,16 @@
 #define SPECIAL  400           /* start of special moves         */
 #define BURN    (SPECIAL+96)   /* start of burn encodings        */
 #define CASTLE  (SPECIAL+100)  /* castling encodings (4)         */
-#define ABSENT  (1<<(SQLEN-1)) /* removed from board (PieceInfo) */
-#define EDGE    (1<<(SQLEN-1)) /* off the board (0x88-style)     */
-#define NPIECES ABSENT+1       /* length of piece + absent lists */
+#define ABSENT   384           /* removed from board (PieceInfo); above all real squares */
+#define EDGE    (1<<SQLEN)     /* off the board (0x88-style); above all piece numbers    */
+#define NPIECES (EDGE+1)       /* length of piece list, + entry for EDGE (qval sentinel) */
 #define SQUARE  ((1<<SQLEN)-1) /* mask for square in move        */
 #define FROM(move) (move>>SQLEN & SQUARE)
 
 #define DEFER   (1<<2*SQLEN)   /* deferral on zone entry */
 #define PROMOTE (1<<2*SQLEN+1) /* promotion bit in move  */
+#define KEYSHIFT (2*SQLEN+2)     /* sort key above this     */
+#define MOVEMASK ((1<<KEYSHIFT)-1) /* move without sort key */
 
 #define BLACK      0
 #define WHITE      1
@@ -73,6 +97,7 @@ typedef struct {
   int promo;
   int value;
   int pst;
+  int kind;      // same for all pieces of one type and color (history index)
   MoveType range[RAYS];
   Flag promoFlag;
   char qval;
@@ -85,7 +110,7 @@ typedef struct {
 
 typedef struct {
   int from, to, piece, victim, new, booty, epSquare, epVictim[RAYS+1], ep2Square, revMoveCount;
-  int savKeyL, savKeyH, gain, loss, filling, saveDelta;
+  int savKeyL, savKeyH, gain, loss, filling, men, saveDelta;
   Flag fireMask;
 } UndoInfo;
 